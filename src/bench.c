@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include "bench.h"
+#include "array.h"
+#include "pacing.h"
+#include "display.h"
+
+bool is_benchmarking = false;
+
+static const char *stage_names[NUM_BENCH_STAGES] = { "load", "transform", "cull", "sort", "raster", "present" };
+
+typedef struct {
+    float mean;
+    float p50;
+    float p99;
+} stage_stats_t;
+
+typedef struct {
+    char model[64];
+    const char *render_method;
+    const char *cull_method;
+    int num_frames;
+    stage_stats_t stages[NUM_BENCH_STAGES];
+} bench_run_t;
+
+static bench_run_t *runs = NULL;
+static bench_run_t current_run;
+
+static double stage_start[NUM_BENCH_STAGES];
+// Time spent in each stage during the current frame, a stage may be entered several times
+static float frame_stage_ms[NUM_BENCH_STAGES];
+// Milliseconds per frame of every stage in the current run
+static float *stage_samples[NUM_BENCH_STAGES];
+// Stages begun and not ended yet, innermost last. Only the innermost one is timed, a stage
+// begun inside another (culling inside the geometry pass) pauses the outer one.
+static enum bench_stage open_stages[NUM_BENCH_STAGES];
+static int num_open_stages = 0;
+
+// Names of the models in ./assets, every .obj file, sorted so the runs come in the same order everywhere
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp((const char *)a, (const char *)b);
+}
+
+int find_bench_models(char names[MAX_BENCH_MODELS][64])
+{
+    DIR *directory = opendir("./assets");
+    if (!directory)
+    {
+        fprintf(stderr, "Error opening ./assets for the benchmark. \n");
+        return 0;
+    }
+
+    int num_names = 0;
+    struct dirent *entry;
+    while ((entry = readdir(directory)) != NULL && num_names < MAX_BENCH_MODELS)
+    {
+        int length = strlen(entry->d_name);
+        if (length > 4 && length - 4 < 64 && strcmp(&entry->d_name[length - 4], ".obj") == 0)
+        {
+            memcpy(names[num_names], entry->d_name, length - 4);
+            names[num_names][length - 4] = '\0';
+            num_names++;
+        }
+    }
+    closedir(directory);
+
+    qsort(names, num_names, sizeof(names[0]), compare_names);
+    return num_names;
+}
+
+void bench_begin_run(const char *model, const char *render_method, const char *cull_method)
+{
+    memset(&current_run, 0, sizeof(current_run));
+    snprintf(current_run.model, sizeof(current_run.model), "%s", model);
+    current_run.render_method = render_method;
+    current_run.cull_method = cull_method;
+
+    for (int i = 0; i < NUM_BENCH_STAGES; i++)
+    {
+        array_free(stage_samples[i]);
+        stage_samples[i] = NULL;
+        frame_stage_ms[i] = 0;
+    }
+    num_open_stages = 0;
+}
+
+void bench_begin_stage(enum bench_stage stage)
+{
+    if (!is_benchmarking || num_open_stages == NUM_BENCH_STAGES)
+    {
+        return;
+    }
+    double now = get_time_seconds();
+    if (num_open_stages > 0)
+    {
+        enum bench_stage outer = open_stages[num_open_stages - 1];
+        frame_stage_ms[outer] += (now - stage_start[outer]) * 1000.0;
+    }
+    open_stages[num_open_stages++] = stage;
+    stage_start[stage] = now;
+}
+
+void bench_end_stage(enum bench_stage stage)
+{
+    if (!is_benchmarking || num_open_stages == 0 || open_stages[num_open_stages - 1] != stage)
+    {
+        return;
+    }
+    double now = get_time_seconds();
+    float elapsed_ms = (now - stage_start[stage]) * 1000.0;
+    num_open_stages--;
+    if (num_open_stages > 0)
+    {
+        stage_start[open_stages[num_open_stages - 1]] = now;
+    }
+
+    // Loading happens once per run, before its first frame
+    if (stage == STAGE_LOAD)
+    {
+        array_push(stage_samples[stage], elapsed_ms);
+        return;
+    }
+    frame_stage_ms[stage] += elapsed_ms;
+}
+
+// Headless frames are never presented, their present stage would only time the capture
+static bool is_stage_reported(int stage)
+{
+    return !(stage == STAGE_PRESENT && is_headless);
+}
+
+void bench_end_frame(void)
+{
+    for (int i = 0; i < NUM_BENCH_STAGES; i++)
+    {
+        if (i != STAGE_LOAD)
+        {
+            array_push(stage_samples[i], frame_stage_ms[i]);
+        }
+        frame_stage_ms[i] = 0;
+    }
+    current_run.num_frames++;
+}
+
+static int compare_floats(const void *a, const void *b)
+{
+    float fa = *(const float *)a;
+    float fb = *(const float *)b;
+    return (fa > fb) - (fa < fb);
+}
+
+void bench_end_run(void)
+{
+    for (int i = 0; i < NUM_BENCH_STAGES; i++)
+    {
+        int num_samples = array_length(stage_samples[i]);
+        if (num_samples == 0)
+        {
+            continue;
+        }
+
+        qsort(stage_samples[i], num_samples, sizeof(float), compare_floats);
+        float sum = 0;
+        for (int j = 0; j < num_samples; j++)
+        {
+            sum += stage_samples[i][j];
+        }
+        current_run.stages[i].mean = sum / num_samples;
+        current_run.stages[i].p50 = stage_samples[i][num_samples / 2];
+        current_run.stages[i].p99 = stage_samples[i][(num_samples * 99) / 100];
+    }
+
+    array_push(runs, current_run);
+    fprintf(stderr, "%-10s %-22s %-8s mean ms:", current_run.model, current_run.render_method, current_run.cull_method);
+    for (int i = STAGE_TRANSFORM; i < NUM_BENCH_STAGES; i++)
+    {
+        if (is_stage_reported(i))
+        {
+            fprintf(stderr, " %s %.2f", stage_names[i], current_run.stages[i].mean);
+        }
+    }
+    fprintf(stderr, " \n");
+}
+
+bool write_bench_results(const char *path, int width, int height, int frames_per_run)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+    {
+        fprintf(stderr, "Error opening benchmark output %s. \n", path);
+        return false;
+    }
+
+    fprintf(file, "{\n  \"width\": %d,\n  \"height\": %d,\n  \"frames_per_run\": %d,\n  \"runs\": [\n", width, height, frames_per_run);
+    int num_runs = array_length(runs);
+    for (int i = 0; i < num_runs; i++)
+    {
+        fprintf(file, "    {\n      \"model\": \"%s\",\n      \"render_method\": \"%s\",\n      \"cull_method\": \"%s\",\n      \"frames\": %d,\n      \"stages_ms\": {\n",
+            runs[i].model, runs[i].render_method, runs[i].cull_method, runs[i].num_frames);
+        bool is_first = true;
+        for (int j = 0; j < NUM_BENCH_STAGES; j++)
+        {
+            if (!is_stage_reported(j))
+            {
+                continue;
+            }
+            fprintf(file, "%s        \"%s\": { \"mean\": %.4f, \"p50\": %.4f, \"p99\": %.4f }",
+                is_first ? "" : ",\n", stage_names[j], runs[i].stages[j].mean, runs[i].stages[j].p50, runs[i].stages[j].p99);
+            is_first = false;
+        }
+        fprintf(file, "\n");
+        fprintf(file, "      }\n    }%s\n", i + 1 < num_runs ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+
+    fclose(file);
+    return true;
+}
+
+void free_bench(void)
+{
+    for (int i = 0; i < NUM_BENCH_STAGES; i++)
+    {
+        array_free(stage_samples[i]);
+        stage_samples[i] = NULL;
+    }
+    array_free(runs);
+    runs = NULL;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdbool.h>
+
+enum bench_stage {
+    STAGE_LOAD,
+    STAGE_TRANSFORM,
+    STAGE_CULL,
+    STAGE_SORT,
+    STAGE_RASTER,
+    STAGE_PRESENT,
+    NUM_BENCH_STAGES
+};
+
+// Stages are only timed while a benchmark runs, the markers cost nothing otherwise.
+// They nest: time in a stage begun inside another is only counted for the inner one.
+extern bool is_benchmarking;
+
+#define MAX_BENCH_MODELS 32
+
+int find_bench_models(char names[MAX_BENCH_MODELS][64]);
+
+void bench_begin_run(const char *model, const char *render_method, const char *cull_method);
+void bench_begin_stage(enum bench_stage stage);
+void bench_end_stage(enum bench_stage stage);
+void bench_end_frame(void);
+void bench_end_run(void);
+
+bool write_bench_results(const char *path, int width, int height, int frames_per_run);
+void free_bench(void);
@@ -0,0 +1,203 @@
+#include <stdlib.h>
+#include "bvh.h"
+#include "array.h"
+
+// Bounds of the 8 transformed corners, done per axis (Arvo's method) instead of transforming each corner
+aabb_t aabb_transform(aabb_t box, mat4_t m) {
+    float min[3] = { m.m[0][3], m.m[1][3], m.m[2][3] };
+    float max[3] = { m.m[0][3], m.m[1][3], m.m[2][3] };
+    float box_min[3] = { box.min.x, box.min.y, box.min.z };
+    float box_max[3] = { box.max.x, box.max.y, box.max.z };
+
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            float a = m.m[i][j] * box_min[j];
+            float b = m.m[i][j] * box_max[j];
+            min[i] += a < b ? a : b;
+            max[i] += a < b ? b : a;
+        }
+    }
+
+    aabb_t result = {
+        { min[0], min[1], min[2] },
+        { max[0], max[1], max[2] }
+    };
+    return result;
+}
+
+aabb_t aabb_union(aabb_t a, aabb_t b) {
+    aabb_t result = {
+        { a.min.x < b.min.x ? a.min.x : b.min.x, a.min.y < b.min.y ? a.min.y : b.min.y, a.min.z < b.min.z ? a.min.z : b.min.z },
+        { a.max.x > b.max.x ? a.max.x : b.max.x, a.max.y > b.max.y ? a.max.y : b.max.y, a.max.z > b.max.z ? a.max.z : b.max.z }
+    };
+    return result;
+}
+
+static float aabb_center(const aabb_t* box, int axis) {
+    if (axis == 0) return (box->min.x + box->max.x) * 0.5;
+    if (axis == 1) return (box->min.y + box->max.y) * 0.5;
+    return (box->min.z + box->max.z) * 0.5;
+}
+
+// qsort has no context argument, so the build passes these through statics
+static const aabb_t* sort_bounds = NULL;
+static int sort_axis = 0;
+
+static int compare_item_centers(const void* a, const void* b) {
+    float ca = aabb_center(&sort_bounds[*(const int*)a], sort_axis);
+    float cb = aabb_center(&sort_bounds[*(const int*)b], sort_axis);
+    return (ca > cb) - (ca < cb);
+}
+
+static int add_node(bvh_t* bvh) {
+    bvh_node_t node = { .left_first = 0, .count = 0 };
+    array_push(bvh->nodes, node);
+    return bvh->num_nodes++;
+}
+
+static void update_node_bounds(bvh_t* bvh, int node_index, const aabb_t* item_bounds) {
+    bvh_node_t* node = &bvh->nodes[node_index];
+    node->bounds = item_bounds[bvh->items[node->left_first]];
+    for (int i = 1; i < node->count; i++) {
+        node->bounds = aabb_union(node->bounds, item_bounds[bvh->items[node->left_first + i]]);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Top-down build, splitting at the median item along the longest axis
+///////////////////////////////////////////////////////////////////////////////
+// A node is a leaf while it holds its items; splitting turns it into an inner
+// node whose two children take the lower and upper half of its item range.
+///////////////////////////////////////////////////////////////////////////////
+static void subdivide(bvh_t* bvh, int node_index, const aabb_t* item_bounds, int max_leaf_items) {
+    bvh_node_t node = bvh->nodes[node_index];
+    if (node.count <= max_leaf_items) {
+        return;
+    }
+
+    // Split the centroids, not the boxes, so large items don't skew the axis choice
+    aabb_t centers = item_bounds[bvh->items[node.left_first]];
+    for (int i = 0; i < node.count; i++) {
+        const aabb_t* box = &item_bounds[bvh->items[node.left_first + i]];
+        vec3_t c = { aabb_center(box, 0), aabb_center(box, 1), aabb_center(box, 2) };
+        aabb_t point = { c, c };
+        centers = i == 0 ? point : aabb_union(centers, point);
+    }
+    vec3_t extent = vec3_sub(centers.max, centers.min);
+    sort_axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+    sort_bounds = item_bounds;
+    qsort(&bvh->items[node.left_first], node.count, sizeof(int), compare_item_centers);
+
+    int left_count = node.count / 2;
+    int left = add_node(bvh);
+    int right = add_node(bvh);
+    bvh->nodes[left].left_first = node.left_first;
+    bvh->nodes[left].count = left_count;
+    bvh->nodes[right].left_first = node.left_first + left_count;
+    bvh->nodes[right].count = node.count - left_count;
+    update_node_bounds(bvh, left, item_bounds);
+    update_node_bounds(bvh, right, item_bounds);
+
+    bvh->nodes[node_index].left_first = left;
+    bvh->nodes[node_index].count = 0;
+
+    subdivide(bvh, left, item_bounds, max_leaf_items);
+    subdivide(bvh, right, item_bounds, max_leaf_items);
+}
+
+void bvh_build(bvh_t* bvh, const aabb_t* item_bounds, int num_items, int max_leaf_items) {
+    bvh_free(bvh);
+    if (num_items == 0) {
+        return;
+    }
+
+    bvh->items = (int*)malloc(sizeof(int) * num_items);
+    for (int i = 0; i < num_items; i++) {
+        bvh->items[i] = i;
+    }
+
+    int root = add_node(bvh);
+    bvh->nodes[root].left_first = 0;
+    bvh->nodes[root].count = num_items;
+    update_node_bounds(bvh, root, item_bounds);
+    subdivide(bvh, root, item_bounds, max_leaf_items < 1 ? 1 : max_leaf_items);
+}
+
+// Recompute the node bounds after items moved, keeping the tree structure.
+// Children come after their parents, so walking backwards visits them first.
+void bvh_refit(bvh_t* bvh, const aabb_t* item_bounds) {
+    for (int i = bvh->num_nodes - 1; i >= 0; i--) {
+        bvh_node_t* node = &bvh->nodes[i];
+        if (node->count > 0) {
+            update_node_bounds(bvh, i, item_bounds);
+        } else {
+            node->bounds = aabb_union(bvh->nodes[node->left_first].bounds, bvh->nodes[node->left_first + 1].bounds);
+        }
+    }
+}
+
+// Median splits keep the depth at log2 of the item count, far below this
+#define BVH_MAX_DEPTH 64
+#define ALL_PLANES_MASK ((1 << NUM_PLANES) - 1)
+
+///////////////////////////////////////////////////////////////////////////////
+// Collect the leaves whose boxes are at least partially inside the frustum
+///////////////////////////////////////////////////////////////////////////////
+// Each stack entry carries a mask of the planes its box may still cross. Once
+// a box is completely inside a plane its whole subtree is too, so the children
+// skip that plane, and a subtree inside all of them is accepted without tests.
+///////////////////////////////////////////////////////////////////////////////
+void bvh_query_frustum(const bvh_t* bvh, const plane_equation_t planes[NUM_PLANES], int** visible_leaves) {
+    if (bvh->num_nodes == 0) {
+        return;
+    }
+
+    int stack_nodes[BVH_MAX_DEPTH * 2];
+    int stack_masks[BVH_MAX_DEPTH * 2];
+    int stack_size = 0;
+    stack_nodes[stack_size] = 0;
+    stack_masks[stack_size++] = ALL_PLANES_MASK;
+
+    while (stack_size > 0) {
+        stack_size--;
+        const bvh_node_t* node = &bvh->nodes[stack_nodes[stack_size]];
+        int mask = stack_masks[stack_size];
+
+        bool is_outside = false;
+        for (int i = 0; i < NUM_PLANES && !is_outside; i++) {
+            if (!(mask & (1 << i))) {
+                continue;
+            }
+            vec3_t n = planes[i].normal;
+            vec3_t near_corner = { n.x >= 0 ? node->bounds.min.x : node->bounds.max.x, n.y >= 0 ? node->bounds.min.y : node->bounds.max.y, n.z >= 0 ? node->bounds.min.z : node->bounds.max.z };
+            vec3_t far_corner = { n.x >= 0 ? node->bounds.max.x : node->bounds.min.x, n.y >= 0 ? node->bounds.max.y : node->bounds.min.y, n.z >= 0 ? node->bounds.max.z : node->bounds.min.z };
+            if (vec3_dot(n, far_corner) + planes[i].distance < 0) {
+                is_outside = true;
+            } else if (vec3_dot(n, near_corner) + planes[i].distance >= 0) {
+                mask &= ~(1 << i);
+            }
+        }
+        if (is_outside) {
+            continue;
+        }
+
+        if (node->count > 0) {
+            int leaf = (int)(node - bvh->nodes);
+            array_push(*visible_leaves, leaf);
+            continue;
+        }
+
+        stack_nodes[stack_size] = node->left_first;
+        stack_masks[stack_size++] = mask;
+        stack_nodes[stack_size] = node->left_first + 1;
+        stack_masks[stack_size++] = mask;
+    }
+}
+
+void bvh_free(bvh_t* bvh) {
+    array_free(bvh->nodes);
+    free(bvh->items);
+    bvh->nodes = NULL;
+    bvh->items = NULL;
+    bvh->num_nodes = 0;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "vector.h"
+#include "matrix.h"
+#include "clipping.h"
+
+typedef struct {
+    vec3_t min;
+    vec3_t max;
+} aabb_t;
+
+typedef struct {
+    aabb_t bounds;
+    int left_first; // Index of the left child (the right one follows it), or of the first item in a leaf
+    int count;      // Number of items in a leaf, 0 for inner nodes
+} bvh_node_t;
+
+typedef struct {
+    bvh_node_t* nodes; // Root first, children are always stored after their parent
+    int* items;        // Item indices ordered so that every leaf covers a contiguous range
+    int num_nodes;
+} bvh_t;
+
+aabb_t aabb_transform(aabb_t box, mat4_t m);
+aabb_t aabb_union(aabb_t a, aabb_t b);
+
+void bvh_build(bvh_t* bvh, const aabb_t* item_bounds, int num_items, int max_leaf_items);
+void bvh_refit(bvh_t* bvh, const aabb_t* item_bounds);
+void bvh_query_frustum(const bvh_t* bvh, const plane_equation_t planes[NUM_PLANES], int** visible_leaves);
+void bvh_free(bvh_t* bvh);
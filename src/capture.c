@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "capture.h"
+
+static enum capture_format capture_format = CAPTURE_NONE;
+static const char *capture_path = NULL;
+static FILE *raw_stream = NULL;
+static int frame_number = 0;
+
+// Buffers are SDL_PIXELFORMAT_RGBA32, so every pixel is laid out in memory as R, G, B, A bytes
+
+static void write_ppm(FILE *file, const uint32_t *pixels, int pitch, int width, int height)
+{
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    uint8_t *row = (uint8_t *)malloc(width * 3);
+    for (int y = 0; y < height; y++)
+    {
+        const uint8_t *src = (const uint8_t *)&pixels[pitch * y];
+        for (int x = 0; x < width; x++)
+        {
+            row[x * 3 + 0] = src[x * 4 + 0];
+            row[x * 3 + 1] = src[x * 4 + 1];
+            row[x * 3 + 2] = src[x * 4 + 2];
+        }
+        fwrite(row, 1, width * 3, file);
+    }
+    free(row);
+}
+
+static uint32_t crc_table[256];
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t length)
+{
+    if (crc_table[1] == 0)
+    {
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            crc_table[n] = c;
+        }
+    }
+    for (size_t i = 0; i < length; i++)
+        crc = crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+static void put_u32_be(uint8_t *out, uint32_t value)
+{
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+static void write_png_chunk(FILE *file, const char *type, const uint8_t *data, uint32_t length)
+{
+    uint8_t header[8];
+    put_u32_be(header, length);
+    memcpy(header + 4, type, 4);
+    fwrite(header, 1, 8, file);
+    fwrite(data, 1, length, file);
+
+    uint32_t crc = crc32_update(0xFFFFFFFFu, (const uint8_t *)type, 4);
+    crc = crc32_update(crc, data, length) ^ 0xFFFFFFFFu;
+    uint8_t footer[4];
+    put_u32_be(footer, crc);
+    fwrite(footer, 1, 4, file);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// PNG with the image data in uncompressed (stored) deflate blocks
+///////////////////////////////////////////////////////////////////////////////
+// Frame dumps are about speed and having no dependencies, so we skip the
+// compression: every scanline gets a 0 (no filter) byte and is stored as is.
+///////////////////////////////////////////////////////////////////////////////
+static void write_png(FILE *file, const uint32_t *pixels, int pitch, int width, int height)
+{
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    fwrite(signature, 1, 8, file);
+
+    uint8_t ihdr[13];
+    put_u32_be(ihdr, width);
+    put_u32_be(ihdr + 4, height);
+    ihdr[8] = 8;  // bit depth
+    ihdr[9] = 6;  // color type RGBA
+    ihdr[10] = 0; // compression
+    ihdr[11] = 0; // filter
+    ihdr[12] = 0; // interlace
+    write_png_chunk(file, "IHDR", ihdr, 13);
+
+    size_t raw_size = (size_t)(width * 4 + 1) * height;
+    size_t num_blocks = (raw_size + 0xFFFF - 1) / 0xFFFF;
+    size_t idat_size = 2 + raw_size + num_blocks * 5 + 4;
+    uint8_t *idat = (uint8_t *)malloc(idat_size);
+    uint8_t *raw = (uint8_t *)malloc(raw_size);
+
+    for (int y = 0; y < height; y++)
+    {
+        uint8_t *row = raw + (size_t)(width * 4 + 1) * y;
+        row[0] = 0;
+        memcpy(row + 1, &pixels[pitch * y], width * 4);
+    }
+
+    // zlib header, stored blocks of at most 65535 bytes, then the adler32 of the raw data
+    uint8_t *out = idat;
+    *out++ = 0x78;
+    *out++ = 0x01;
+    uint32_t adler_a = 1;
+    uint32_t adler_b = 0;
+    for (size_t offset = 0; offset < raw_size; offset += 0xFFFF)
+    {
+        size_t length = raw_size - offset < 0xFFFF ? raw_size - offset : 0xFFFF;
+        *out++ = (offset + length == raw_size) ? 1 : 0;
+        *out++ = length & 0xFF;
+        *out++ = (length >> 8) & 0xFF;
+        *out++ = ~length & 0xFF;
+        *out++ = (~length >> 8) & 0xFF;
+        memcpy(out, raw + offset, length);
+        out += length;
+
+        for (size_t i = 0; i < length; i++)
+        {
+            adler_a = (adler_a + raw[offset + i]) % 65521;
+            adler_b = (adler_b + adler_a) % 65521;
+        }
+    }
+    put_u32_be(out, (adler_b << 16) | adler_a);
+    out += 4;
+
+    write_png_chunk(file, "IDAT", idat, (uint32_t)(out - idat));
+    write_png_chunk(file, "IEND", NULL, 0);
+
+    free(raw);
+    free(idat);
+}
+
+// The pattern goes to snprintf with the frame number, so it may hold one integer conversion
+// like %04d and otherwise only %%. Without a conversion every frame goes to the same file.
+static bool is_valid_frame_pattern(const char *pattern)
+{
+    int num_conversions = 0;
+    for (const char *c = pattern; *c; c++)
+    {
+        if (*c != '%')
+        {
+            continue;
+        }
+        c++;
+        if (*c == '%')
+        {
+            continue;
+        }
+        while (*c == '0' || *c == '-' || *c == '+' || *c == ' ')
+        {
+            c++;
+        }
+        while (*c >= '0' && *c <= '9')
+        {
+            c++;
+        }
+        if (*c != 'd' && *c != 'i')
+        {
+            return false;
+        }
+        num_conversions++;
+    }
+    return num_conversions <= 1;
+}
+
+// The path is a printf pattern with the frame number for PPM and PNG, e.g. "frame_%04d.png"
+bool open_capture(const char *path, enum capture_format format)
+{
+    if ((format == CAPTURE_PPM || format == CAPTURE_PNG) && !is_valid_frame_pattern(path))
+    {
+        fprintf(stderr, "Error in capture pattern %s, it takes a single %%d for the frame number. \n", path);
+        capture_format = CAPTURE_NONE;
+        return false;
+    }
+
+    capture_format = format;
+    capture_path = path;
+    frame_number = 0;
+
+    if (format == CAPTURE_RAW)
+    {
+        raw_stream = strcmp(path, "-") == 0 ? stdout : fopen(path, "wb");
+        if (!raw_stream)
+        {
+            fprintf(stderr, "Error opening capture output %s. \n", path);
+            capture_format = CAPTURE_NONE;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void capture_frame(const uint32_t *pixels, int pitch, int width, int height)
+{
+    if (capture_format == CAPTURE_RAW)
+    {
+        for (int y = 0; y < height; y++)
+        {
+            fwrite(&pixels[pitch * y], sizeof(uint32_t), width, raw_stream);
+        }
+    }
+    else if (capture_format == CAPTURE_PPM || capture_format == CAPTURE_PNG)
+    {
+        char filename[1024];
+        snprintf(filename, sizeof(filename), capture_path, frame_number);
+        FILE *file = fopen(filename, "wb");
+        if (!file)
+        {
+            fprintf(stderr, "Error writing frame %s. \n", filename);
+        }
+        else
+        {
+            if (capture_format == CAPTURE_PPM)
+                write_ppm(file, pixels, pitch, width, height);
+            else
+                write_png(file, pixels, pitch, width, height);
+            fclose(file);
+        }
+    }
+
+    frame_number++;
+}
+
+void close_capture(void)
+{
+    if (raw_stream && raw_stream != stdout)
+    {
+        fclose(raw_stream);
+    }
+    if (raw_stream == stdout)
+    {
+        fflush(stdout);
+    }
+    raw_stream = NULL;
+    capture_format = CAPTURE_NONE;
+}
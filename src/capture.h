@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum capture_format {
+    CAPTURE_NONE,
+    CAPTURE_PPM, // One binary PPM file per frame
+    CAPTURE_PNG, // One PNG file per frame
+    CAPTURE_RAW  // All frames back to back as raw RGBA bytes, to a file or "-" for stdout
+};
+
+bool open_capture(const char *path, enum capture_format format);
+void capture_frame(const uint32_t *pixels, int pitch, int width, int height);
+void close_capture(void);
@@ -1,7 +1,6 @@
 #include <math.h>
 #include "clipping.h"
 
-#define NUM_PLANES 6
 plane_t frustum_planes[NUM_PLANES];
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -9,10 +8,10 @@ plane_t frustum_planes[NUM_PLANES];
 ///////////////////////////////////////////////////////////////////////////////
 // Near plane   :  P=(0, 0, znear), N=(0, 0,  1)
 // Far plane    :  P=(0, 0, zfar),  N=(0, 0, -1)
-// Top plane    :  P=(0, 0, 0),     N=(0, -cos(fov/2), sin(fov/2))
-// Bottom plane :  P=(0, 0, 0),     N=(0, cos(fov/2), sin(fov/2))
-// Left plane   :  P=(0, 0, 0),     N=(cos(fov/2), 0, sin(fov/2))
-// Right plane  :  P=(0, 0, 0),     N=(-cos(fov/2), 0, sin(fov/2))
+// Top plane    :  P=(0, 0, 0),     N=(0, -cos(fov_y/2), sin(fov_y/2))
+// Bottom plane :  P=(0, 0, 0),     N=(0, cos(fov_y/2), sin(fov_y/2))
+// Left plane   :  P=(0, 0, 0),     N=(cos(fov_x/2), 0, sin(fov_x/2))
+// Right plane  :  P=(0, 0, 0),     N=(-cos(fov_x/2), 0, sin(fov_x/2))
 ///////////////////////////////////////////////////////////////////////////////
 //
 //           /|\
@@ -26,29 +25,31 @@ plane_t frustum_planes[NUM_PLANES];
 //           \|/
 //
 ///////////////////////////////////////////////////////////////////////////////
-void init_frustum_planes(float fov, float z_near, float z_far) {
-	float cos_half_fov = cos(fov / 2);
-	float sin_half_fov = sin(fov / 2);
+void init_frustum_planes(float fov_x, float fov_y, float z_near, float z_far) {
+	float cos_half_fov_x = cos(fov_x / 2);
+	float sin_half_fov_x = sin(fov_x / 2);
+	float cos_half_fov_y = cos(fov_y / 2);
+	float sin_half_fov_y = sin(fov_y / 2);
 
 	frustum_planes[LEFT_FRUSTUM_PLANE].point = vec3_new(0, 0, 0);
-	frustum_planes[LEFT_FRUSTUM_PLANE].normal.x = cos_half_fov;
+	frustum_planes[LEFT_FRUSTUM_PLANE].normal.x = cos_half_fov_x;
 	frustum_planes[LEFT_FRUSTUM_PLANE].normal.y = 0;
-	frustum_planes[LEFT_FRUSTUM_PLANE].normal.z = sin_half_fov;
+	frustum_planes[LEFT_FRUSTUM_PLANE].normal.z = sin_half_fov_x;
 
 	frustum_planes[RIGHT_FRUSTUM_PLANE].point = vec3_new(0, 0, 0);
-	frustum_planes[RIGHT_FRUSTUM_PLANE].normal.x = -cos_half_fov;
+	frustum_planes[RIGHT_FRUSTUM_PLANE].normal.x = -cos_half_fov_x;
 	frustum_planes[RIGHT_FRUSTUM_PLANE].normal.y = 0;
-	frustum_planes[RIGHT_FRUSTUM_PLANE].normal.z = sin_half_fov;
+	frustum_planes[RIGHT_FRUSTUM_PLANE].normal.z = sin_half_fov_x;
 
 	frustum_planes[TOP_FRUSTUM_PLANE].point = vec3_new(0, 0, 0);
 	frustum_planes[TOP_FRUSTUM_PLANE].normal.x = 0;
-	frustum_planes[TOP_FRUSTUM_PLANE].normal.y = -cos_half_fov;
-	frustum_planes[TOP_FRUSTUM_PLANE].normal.z = sin_half_fov;
+	frustum_planes[TOP_FRUSTUM_PLANE].normal.y = -cos_half_fov_y;
+	frustum_planes[TOP_FRUSTUM_PLANE].normal.z = sin_half_fov_y;
 
 	frustum_planes[BOTTOM_FRUSTUM_PLANE].point = vec3_new(0, 0, 0);
 	frustum_planes[BOTTOM_FRUSTUM_PLANE].normal.x = 0;
-	frustum_planes[BOTTOM_FRUSTUM_PLANE].normal.y = cos_half_fov;
-	frustum_planes[BOTTOM_FRUSTUM_PLANE].normal.z = sin_half_fov;
+	frustum_planes[BOTTOM_FRUSTUM_PLANE].normal.y = cos_half_fov_y;
+	frustum_planes[BOTTOM_FRUSTUM_PLANE].normal.z = sin_half_fov_y;
 
 	frustum_planes[NEAR_FRUSTUM_PLANE].point = vec3_new(0, 0, z_near);
 	frustum_planes[NEAR_FRUSTUM_PLANE].normal.x = 0;
@@ -60,3 +61,53 @@ void init_frustum_planes(float fov, float z_near, float z_far) {
 	frustum_planes[FAR_FRUSTUM_PLANE].normal.y = 0;
 	frustum_planes[FAR_FRUSTUM_PLANE].normal.z = -1;
 }
+
+///////////////////////////////////////////////////////////////////////////////
+// Bring the view space frustum planes into the space of an object
+///////////////////////////////////////////////////////////////////////////////
+// With p_view = R * p_object + t (R may contain scale), the inside test
+// dot(N, p_view - P) >= 0 becomes dot(R^T N, p_object) + dot(N, t - P) >= 0.
+// The result is normalized so bounding sphere tests can compare distances.
+///////////////////////////////////////////////////////////////////////////////
+void frustum_planes_to_object_space(mat4_t model_view, plane_equation_t planes[NUM_PLANES]) {
+	vec3_t t = { model_view.m[0][3], model_view.m[1][3], model_view.m[2][3] };
+
+	for (int i = 0; i < NUM_PLANES; i++) {
+		vec3_t n = frustum_planes[i].normal;
+		vec3_t normal = {
+			model_view.m[0][0] * n.x + model_view.m[1][0] * n.y + model_view.m[2][0] * n.z,
+			model_view.m[0][1] * n.x + model_view.m[1][1] * n.y + model_view.m[2][1] * n.z,
+			model_view.m[0][2] * n.x + model_view.m[1][2] * n.y + model_view.m[2][2] * n.z
+		};
+		float distance = vec3_dot(n, vec3_sub(t, frustum_planes[i].point));
+
+		float length = vec3_length(normal);
+		planes[i].normal = vec3_div(normal, length);
+		planes[i].distance = distance / length;
+	}
+}
+
+bool sphere_in_frustum(const plane_equation_t planes[NUM_PLANES], vec3_t center, float radius) {
+	for (int i = 0; i < NUM_PLANES; i++) {
+		if (vec3_dot(planes[i].normal, center) + planes[i].distance < -radius) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Test the box corner furthest along each plane normal, if even that one is outside so is the box
+bool aabb_in_frustum(const plane_equation_t planes[NUM_PLANES], vec3_t min, vec3_t max) {
+	for (int i = 0; i < NUM_PLANES; i++) {
+		vec3_t n = planes[i].normal;
+		vec3_t corner = {
+			n.x >= 0 ? max.x : min.x,
+			n.y >= 0 ? max.y : min.y,
+			n.z >= 0 ? max.z : min.z
+		};
+		if (vec3_dot(n, corner) + planes[i].distance < 0) {
+			return false;
+		}
+	}
+	return true;
+}
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <stdbool.h>
 #include "vector.h"
+#include "matrix.h"
+
+#define NUM_PLANES 6
 
 enum {
     LEFT_FRUSTUM_PLANE,
@@ -16,4 +20,15 @@ typedef struct {
     vec3_t normal;
 } plane_t;
 
-void init_frustum_planes(float fov, float z_near, float z_far);
+// Plane as a normal and a signed distance, points with dot(normal, p) + distance >= 0 are inside
+typedef struct {
+    vec3_t normal;
+    float distance;
+} plane_equation_t;
+
+extern plane_t frustum_planes[NUM_PLANES];
+
+void init_frustum_planes(float fov_x, float fov_y, float z_near, float z_far);
+void frustum_planes_to_object_space(mat4_t model_view, plane_equation_t planes[NUM_PLANES]);
+bool sphere_in_frustum(const plane_equation_t planes[NUM_PLANES], vec3_t center, float radius);
+bool aabb_in_frustum(const plane_equation_t planes[NUM_PLANES], vec3_t min, vec3_t max);
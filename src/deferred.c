@@ -0,0 +1,251 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "deferred.h"
+#include "display.h"
+#include "light.h"
+#include "jobs.h"
+#include "stats.h"
+#include "trace.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+bool is_deferred_shading = false;
+
+// Pixels shaded together, lit with one call to light_modulate
+#define SHADE_CHUNK 64
+
+// Triangles are not clipped, ones with a vertex closer than this would get infinite or flipped 1/w
+#define DEFERRED_NEAR 0.1
+
+typedef struct {
+    int width;
+    int height;
+    int capacity;
+    float *inv_w;
+    int *triangle;
+    float *b_w;
+    float *c_w;
+} g_buffer_t;
+
+static g_buffer_t g_buffer = { 0, 0, 0, NULL, NULL, NULL, NULL };
+
+// What every band of the shading pass needs to know
+typedef struct {
+    const triangle_t *triangles;
+    bool is_textured;
+    bool is_gouraud;
+    int *band_pixels;  // Pixels shaded by every band, summed once the jobs are done
+} shade_pass_t;
+
+static void resize_g_buffer(int width, int height) {
+    if (width * height > g_buffer.capacity) {
+        g_buffer.capacity = width * height;
+        g_buffer.inv_w = (float *)realloc(g_buffer.inv_w, sizeof(float) * g_buffer.capacity);
+        g_buffer.triangle = (int *)realloc(g_buffer.triangle, sizeof(int) * g_buffer.capacity);
+        g_buffer.b_w = (float *)realloc(g_buffer.b_w, sizeof(float) * g_buffer.capacity);
+        g_buffer.c_w = (float *)realloc(g_buffer.c_w, sizeof(float) * g_buffer.capacity);
+    }
+    g_buffer.width = width;
+    g_buffer.height = height;
+    memset(g_buffer.inv_w, 0, sizeof(float) * width * height);
+}
+
+// Pixel centers inside the triangle and nearer than what is there get its index and weights
+static void raster_triangle(const triangle_t *triangle, int index) {
+    vec4_t a = triangle->vertices[0];
+    vec4_t b = triangle->vertices[1];
+    vec4_t c = triangle->vertices[2];
+
+    float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    if (fabs(area) < 1e-8) {
+        return;
+    }
+
+    int min_x = (int)floorf(fminf(a.x, fminf(b.x, c.x)));
+    int max_x = (int)ceilf(fmaxf(a.x, fmaxf(b.x, c.x)));
+    int min_y = (int)floorf(fminf(a.y, fminf(b.y, c.y)));
+    int max_y = (int)ceilf(fmaxf(a.y, fmaxf(b.y, c.y)));
+    if (min_x < 0) min_x = 0;
+    if (min_y < 0) min_y = 0;
+    if (max_x > g_buffer.width - 1) max_x = g_buffer.width - 1;
+    if (max_y > g_buffer.height - 1) max_y = g_buffer.height - 1;
+    if (min_x > max_x || min_y > max_y) {
+        return;
+    }
+    mark_dirty_rect(min_x, min_y, max_x - min_x + 1, max_y - min_y + 1);
+    STAT_ADD(triangles_rasterized, 1);
+    STAT_ADD(pixels_tested, (max_x - min_x + 1) * (max_y - min_y + 1));
+
+    // Edge function of the edge p->q at (x, y): (q.x - p.x) * (y - p.y) - (q.y - p.y) * (x - p.x).
+    // Each is the weight of the opposite vertex times the area, scaled here to give that weight over w.
+    float scales[3] = { 1 / (a.w * area), 1 / (b.w * area), 1 / (c.w * area) };
+    vec4_t origins[3] = { b, c, a };
+    vec4_t ends[3] = { c, a, b };
+    float e_dx[3], e_dy[3], e_row[3];
+    float start_x = min_x + 0.5;
+    float start_y = min_y + 0.5;
+    for (int i = 0; i < 3; i++) {
+        e_dx[i] = -(ends[i].y - origins[i].y) * scales[i];
+        e_dy[i] = (ends[i].x - origins[i].x) * scales[i];
+        e_row[i] = e_dy[i] * (start_y - origins[i].y) + e_dx[i] * (start_x - origins[i].x);
+    }
+
+    for (int y = min_y; y <= max_y; y++) {
+        int offset = y * g_buffer.width;
+        float a_w = e_row[0], b_w = e_row[1], c_w = e_row[2];
+        for (int x = min_x; x <= max_x; x++) {
+            // Dividing by the area makes the weights positive inside whichever way the triangle winds,
+            // and w is positive since triangles reaching past the near plane were dropped
+            float inv_w = a_w + b_w + c_w;
+            if (a_w >= 0 && b_w >= 0 && c_w >= 0 && inv_w > g_buffer.inv_w[offset + x]) {
+                g_buffer.inv_w[offset + x] = inv_w;
+                g_buffer.triangle[offset + x] = index;
+                g_buffer.b_w[offset + x] = b_w;
+                g_buffer.c_w[offset + x] = c_w;
+            }
+            a_w += e_dx[0];
+            b_w += e_dx[1];
+            c_w += e_dx[2];
+        }
+        for (int i = 0; i < 3; i++) {
+            e_row[i] += e_dy[i];
+        }
+    }
+}
+
+// Perspective correct weights of vertices b and c for count pixels, from their weights over w
+static void divide_weights(const float *inv_w, float *b, float *c, int count) {
+    int i = 0;
+#if defined(__SSE2__)
+    for (; i + 4 <= count; i += 4) {
+        __m128 w = _mm_div_ps(_mm_set1_ps(1), _mm_loadu_ps(&inv_w[i]));
+        _mm_storeu_ps(&b[i], _mm_mul_ps(_mm_loadu_ps(&b[i]), w));
+        _mm_storeu_ps(&c[i], _mm_mul_ps(_mm_loadu_ps(&c[i]), w));
+    }
+#endif
+    for (; i < count; i++) {
+        float w = 1 / inv_w[i];
+        b[i] *= w;
+        c[i] *= w;
+    }
+}
+
+// Light level of a pixel from the vertex intensities, in the 8.8 format of light_modulate
+static uint16_t interpolate_level(const triangle_t *triangle, float a, float b, float c) {
+    float intensity = triangle->intensities[0] * a + triangle->intensities[1] * b + triangle->intensities[2] * c;
+    if (intensity < 0) intensity = 0;
+    if (intensity > 1) intensity = 1;
+    return (uint16_t)(intensity * 256 + 0.5);
+}
+
+// Covered pixels of a row are gathered in chunks, their weights divided four at a time,
+// their colors looked up, and then lit four at a time before they are scattered back
+static void shade_band(int band, void *data) {
+    trace_begin("shade_band");
+    const shade_pass_t *pass = (const shade_pass_t *)data;
+    int y_start = band * DEFERRED_BAND_HEIGHT;
+    int y_end = y_start + DEFERRED_BAND_HEIGHT < g_buffer.height ? y_start + DEFERRED_BAND_HEIGHT : g_buffer.height;
+
+    int xs[SHADE_CHUNK];
+    float inv_w[SHADE_CHUNK];
+    float b[SHADE_CHUNK];
+    float c[SHADE_CHUNK];
+    uint32_t colors[SHADE_CHUNK];
+    uint16_t levels[SHADE_CHUNK];
+
+    for (int y = y_start; y < y_end; y++) {
+        int offset = y * g_buffer.width;
+        uint32_t *row = &color_buffer[color_buffer_pitch * y];
+
+        int x = 0;
+        while (x < g_buffer.width) {
+            int count = 0;
+            for (; x < g_buffer.width && count < SHADE_CHUNK; x++) {
+                if (g_buffer.inv_w[offset + x] > 0) {
+                    xs[count] = x;
+                    inv_w[count] = g_buffer.inv_w[offset + x];
+                    b[count] = g_buffer.b_w[offset + x];
+                    c[count] = g_buffer.c_w[offset + x];
+                    count++;
+                }
+            }
+            if (count == 0) {
+                continue;
+            }
+            pass->band_pixels[band] += count;
+
+            divide_weights(inv_w, b, c, count);
+
+            for (int i = 0; i < count; i++) {
+                const triangle_t *triangle = &pass->triangles[g_buffer.triangle[offset + xs[i]]];
+                float a = 1 - b[i] - c[i];
+
+                if (pass->is_textured) {
+                    texture_t *texture = triangle->texture;
+                    float u = triangle->texcoords[0].u * a + triangle->texcoords[1].u * b[i] + triangle->texcoords[2].u * c[i];
+                    float v = triangle->texcoords[0].v * a + triangle->texcoords[1].v * b[i] + triangle->texcoords[2].v * c[i];
+                    int tex_x = abs((int)(u * texture->width)) % texture->width;
+                    int tex_y = abs((int)(v * texture->height)) % texture->height;
+                    colors[i] = texture->texels[(texture->width * tex_y) + tex_x];
+                    levels[i] = interpolate_level(triangle, a, b[i], c[i]);
+                } else {
+                    // Flat colors are already lit
+                    colors[i] = triangle->color;
+                    levels[i] = pass->is_gouraud ? interpolate_level(triangle, a, b[i], c[i]) : 256;
+                }
+            }
+
+            if (pass->is_textured || pass->is_gouraud) {
+                light_modulate(colors, levels, count);
+            }
+            for (int i = 0; i < count; i++) {
+                row[xs[i]] = colors[i];
+            }
+        }
+    }
+    trace_end();
+}
+
+void draw_deferred_triangles(const triangle_t *triangles, int num_triangles, bool is_textured, bool is_gouraud) {
+    trace_begin("g_buffer");
+    resize_g_buffer(render_width, render_height);
+
+    for (int i = 0; i < num_triangles; i++) {
+        // Textured modes draw nothing for triangles without a texture
+        if (is_textured && (triangles[i].texture == NULL || triangles[i].texture->texels == NULL)) {
+            continue;
+        }
+        const vec4_t *vertices = triangles[i].vertices;
+        if (vertices[0].w < DEFERRED_NEAR || vertices[1].w < DEFERRED_NEAR || vertices[2].w < DEFERRED_NEAR) {
+            continue;
+        }
+        raster_triangle(&triangles[i], i);
+    }
+    trace_end();
+
+    int num_bands = (g_buffer.height + DEFERRED_BAND_HEIGHT - 1) / DEFERRED_BAND_HEIGHT;
+    shade_pass_t pass = { triangles, is_textured, is_gouraud, (int *)calloc(num_bands, sizeof(int)) };
+    trace_begin("shade");
+    run_jobs(shade_band, &pass, num_bands);
+    trace_end();
+
+    // Every shaded pixel is written once, and textured ones fetch one texel
+    for (int i = 0; i < num_bands; i++) {
+        STAT_ADD(pixels_written, pass.band_pixels[i]);
+        if (is_textured) {
+            STAT_ADD(texels_fetched, pass.band_pixels[i]);
+        }
+    }
+    free(pass.band_pixels);
+}
+
+void free_deferred(void) {
+    free(g_buffer.inv_w);
+    free(g_buffer.triangle);
+    free(g_buffer.b_w);
+    free(g_buffer.c_w);
+    g_buffer = (g_buffer_t){ 0, 0, 0, NULL, NULL, NULL, NULL };
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "triangle.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Deferred shading
+///////////////////////////////////////////////////////////////////////////////
+// Painter's order shades every pixel once per triangle drawn over it. Here
+// the triangles are first rasterized without any shading into a G-buffer,
+// keeping only the nearest one per pixel:
+//
+//   inv_w        1/w of the pixel, larger is nearer, 0 where nothing is drawn
+//   triangle     index of the triangle in the list being drawn
+//   b_w, c_w     barycentric weights of vertices b and c over w
+//
+// All three of 1/w, b/w and c/w are linear on screen, so the raster pass is
+// plain edge function stepping, and dividing by 1/w gives the perspective
+// correct weights back. Then every covered pixel is shaded exactly once, in
+// bands of rows spread over the job threads.
+//
+// The job threads are only started when deferred shading is enabled at
+// startup (--deferred), without them run_jobs() shades every band on the
+// thread building the frame.
+///////////////////////////////////////////////////////////////////////////////
+#define DEFERRED_BAND_HEIGHT 16
+
+extern bool is_deferred_shading;
+
+void draw_deferred_triangles(const triangle_t *triangles, int num_triangles, bool is_textured, bool is_gouraud);
+void free_deferred(void);
@@ -0,0 +1,118 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "depth.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+void init_depth_buffer(depth_buffer_t* buffer, int width, int height) {
+    buffer->width = (width + 3) & ~3;
+    buffer->height = height;
+    buffer->depth = (float*)malloc(sizeof(float) * buffer->width * height);
+    clear_depth_buffer(buffer);
+}
+
+void clear_depth_buffer(depth_buffer_t* buffer) {
+    memset(buffer->depth, 0, sizeof(float) * buffer->width * buffer->height);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// The triangle is walked over its bounding box with three edge functions and
+// a depth plane, all of them linear in x and y. A pixel is inside when its
+// center has every edge function >= 0. Four pixels of a row are tested and
+// written together, starting at a multiple of 4.
+///////////////////////////////////////////////////////////////////////////////
+void draw_depth_triangle(depth_buffer_t* buffer, vec3_t a, vec3_t b, vec3_t c) {
+    float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    if (fabs(area) < 1e-8) {
+        return;
+    }
+    // Counter-clockwise on screen makes every edge function positive inside
+    if (area < 0) {
+        vec3_t temp = b;
+        b = c;
+        c = temp;
+        area = -area;
+    }
+
+    int min_x = (int)floorf(fminf(a.x, fminf(b.x, c.x)));
+    int max_x = (int)ceilf(fmaxf(a.x, fmaxf(b.x, c.x)));
+    int min_y = (int)floorf(fminf(a.y, fminf(b.y, c.y)));
+    int max_y = (int)ceilf(fmaxf(a.y, fmaxf(b.y, c.y)));
+    if (min_x < 0) min_x = 0;
+    if (min_y < 0) min_y = 0;
+    if (max_x > buffer->width - 1) max_x = buffer->width - 1;
+    if (max_y > buffer->height - 1) max_y = buffer->height - 1;
+    if (min_x > max_x || min_y > max_y) {
+        return;
+    }
+    min_x &= ~3;
+
+    // Edge function of the edge p->q at (x, y): (q.x - p.x) * (y - p.y) - (q.y - p.y) * (x - p.x)
+    float e_dx[3] = { -(c.y - b.y), -(a.y - c.y), -(b.y - a.y) };
+    float e_dy[3] = { c.x - b.x, a.x - c.x, b.x - a.x };
+    vec3_t origins[3] = { b, c, a };
+
+    // Barycentric weights are the edge functions over the area, so is the depth plane
+    float z_dx = (e_dx[0] * a.z + e_dx[1] * b.z + e_dx[2] * c.z) / area;
+    float z_dy = (e_dy[0] * a.z + e_dy[1] * b.z + e_dy[2] * c.z) / area;
+
+    float start_x = min_x + 0.5;
+    float start_y = min_y + 0.5;
+    float e_row[3];
+    for (int i = 0; i < 3; i++) {
+        e_row[i] = e_dy[i] * (start_y - origins[i].y) + e_dx[i] * (start_x - origins[i].x);
+    }
+    float z_row = a.z + z_dx * (start_x - a.x) + z_dy * (start_y - a.y);
+
+    for (int y = min_y; y <= max_y; y++) {
+        float* row = &buffer->depth[y * buffer->width];
+#if defined(__SSE2__)
+        __m128 lane_offsets = _mm_set_ps(3, 2, 1, 0);
+        __m128 e0 = _mm_add_ps(_mm_set1_ps(e_row[0]), _mm_mul_ps(lane_offsets, _mm_set1_ps(e_dx[0])));
+        __m128 e1 = _mm_add_ps(_mm_set1_ps(e_row[1]), _mm_mul_ps(lane_offsets, _mm_set1_ps(e_dx[1])));
+        __m128 e2 = _mm_add_ps(_mm_set1_ps(e_row[2]), _mm_mul_ps(lane_offsets, _mm_set1_ps(e_dx[2])));
+        __m128 z = _mm_add_ps(_mm_set1_ps(z_row), _mm_mul_ps(lane_offsets, _mm_set1_ps(z_dx)));
+        __m128 e0_step = _mm_set1_ps(e_dx[0] * 4);
+        __m128 e1_step = _mm_set1_ps(e_dx[1] * 4);
+        __m128 e2_step = _mm_set1_ps(e_dx[2] * 4);
+        __m128 z_step = _mm_set1_ps(z_dx * 4);
+        __m128 zero = _mm_setzero_ps();
+
+        for (int x = min_x; x <= max_x; x += 4) {
+            __m128 inside = _mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_and_ps(_mm_cmpge_ps(e1, zero), _mm_cmpge_ps(e2, zero)));
+            if (_mm_movemask_ps(inside)) {
+                __m128 old_depth = _mm_loadu_ps(&row[x]);
+                __m128 nearest = _mm_max_ps(old_depth, z);
+                _mm_storeu_ps(&row[x], _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old_depth)));
+            }
+            e0 = _mm_add_ps(e0, e0_step);
+            e1 = _mm_add_ps(e1, e1_step);
+            e2 = _mm_add_ps(e2, e2_step);
+            z = _mm_add_ps(z, z_step);
+        }
+#else
+        for (int x = min_x; x <= max_x; x++) {
+            float dx = x - min_x;
+            float w0 = e_row[0] + e_dx[0] * dx;
+            float w1 = e_row[1] + e_dx[1] * dx;
+            float w2 = e_row[2] + e_dx[2] * dx;
+            float z = z_row + z_dx * dx;
+            if (w0 >= 0 && w1 >= 0 && w2 >= 0 && z > row[x]) {
+                row[x] = z;
+            }
+        }
+#endif
+        for (int i = 0; i < 3; i++) {
+            e_row[i] += e_dy[i];
+        }
+        z_row += z_dy;
+    }
+}
+
+void free_depth_buffer(depth_buffer_t* buffer) {
+    free(buffer->depth);
+    buffer->depth = NULL;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "vector.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Depth-only rasterizer
+///////////////////////////////////////////////////////////////////////////////
+// Writes no color, only the nearest depth per pixel. Depth values must grow
+// towards the viewer (1/w for a perspective view), which makes them linear in
+// screen space and lets a cleared buffer of 0 stand for "nothing drawn".
+///////////////////////////////////////////////////////////////////////////////
+typedef struct {
+    int width;   // Multiple of 4, rows are processed 4 pixels at a time
+    int height;
+    float* depth;
+} depth_buffer_t;
+
+void init_depth_buffer(depth_buffer_t* buffer, int width, int height);
+void clear_depth_buffer(depth_buffer_t* buffer);
+void draw_depth_triangle(depth_buffer_t* buffer, vec3_t a, vec3_t b, vec3_t c);
+void free_depth_buffer(depth_buffer_t* buffer);
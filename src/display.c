@@ -1,14 +1,46 @@
+#include <string.h>
 #include "display.h"
+#include "pacing.h"
+#include "stats.h"
+#include "heatmap.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Render offscreen without a window, renderer or SDL video, for servers and CI machines
+bool is_headless = false;
 
 SDL_Window *window = NULL;
 SDL_Renderer *renderer = NULL;
 
+enum present_mode present_mode = PRESENT_LOCKED_TEXTURE;
+
+// The buffer the rasterizer writes to this frame, either the back buffer or the locked texture pixels
 uint32_t *color_buffer = NULL;
+uint32_t *back_buffer = NULL;
+// Number of pixels between the start of two rows of color_buffer (not always window_width when locked)
+int color_buffer_pitch = 800;
 SDL_Texture *color_buffer_texture = NULL;
 
+static bool is_texture_locked = false;
+
+// Dirty regions of the color buffer being drawn this frame and of the buffers it can point to
+static dirty_region_t back_buffer_dirty = { .num_rects = 0, .is_full = true };
+static dirty_region_t texture_dirty = { .num_rects = 0, .is_full = true };
+dirty_region_t *color_buffer_dirty = &back_buffer_dirty;
+
+// Pre-rendered clear color and grid, copied over whatever was drawn last frame
+uint32_t *background_buffer = NULL;
+
 int window_width = 800;
 int window_height = 600;
 
+// Internal resolution we rasterize at, the top-left part of the buffers that SDL scales up to the window
+int render_width = 800;
+int render_height = 600;
+float render_scale = 1.0;
+
 bool initialize_window(void)
 {
     if (SDL_Init(SDL_INIT_EVERYTHING) != 0)
@@ -22,6 +54,7 @@ bool initialize_window(void)
 
     window_width = display_mode.w;
     window_height = display_mode.h;
+    set_render_scale(render_scale);
 
     window = SDL_CreateWindow(
         NULL,
@@ -37,7 +70,8 @@ bool initialize_window(void)
         return false;
     }
 
-    renderer = SDL_CreateRenderer(window, -1, 0);
+    // With vsync pacing SDL_RenderPresent waits for the display instead of us sleeping
+    renderer = SDL_CreateRenderer(window, -1, frame_pacing == PACING_VSYNC ? SDL_RENDERER_PRESENTVSYNC : 0);
 
     if (!renderer)
     {
@@ -47,29 +81,256 @@ bool initialize_window(void)
 
     SDL_SetWindowFullscreen(window, SDL_WINDOW_FULLSCREEN);
 
+    // Smooth out the upscale when rendering below native resolution
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
+
     return true;
 }
 
-void draw_grid(void)
+bool initialize_headless(int width, int height)
+{
+    // Only the timer is needed for frame timing, there is no display to talk to
+    if (SDL_Init(SDL_INIT_TIMER) != 0)
+    {
+        fprintf(stderr, "Error initializing SDL. \n");
+        return false;
+    }
+
+    is_headless = true;
+    present_mode = PRESENT_COPY;
+    window_width = width;
+    window_height = height;
+    set_render_scale(render_scale);
+
+    return true;
+}
+
+// Fill a row with non-temporal stores, 4 pixels at a time, so the clear doesn't evict the cache
+static void fill_row(uint32_t *row, int count, uint32_t color)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    // Scalar stores until the row is 16-byte aligned
+    while (i < count && ((uintptr_t)(row + i) & 15) != 0)
+    {
+        row[i++] = color;
+    }
+    __m128i wide_color = _mm_set1_epi32((int)color);
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm_stream_si128((__m128i *)(row + i), wide_color);
+    }
+#endif
+    for (; i < count; i++)
+    {
+        row[i] = color;
+    }
+}
+
+// Render the clear color and the grid dots once, instead of stamping the grid every frame
+void init_background(uint32_t color)
 {
+    background_buffer = (uint32_t *)malloc(sizeof(uint32_t) * window_width * window_height);
+
+    for (int y = 0; y < window_height; y++)
+    {
+        fill_row(&background_buffer[window_width * y], window_width, color);
+    }
+#if defined(__SSE2__)
+    _mm_sfence();
+#endif
+
     for (int y = 0; y < window_height; y += 10)
     {
         for (int x = 0; x < window_width; x += 10)
         {
-            color_buffer[(window_width * y) + x] = 0xFF333333;
+            background_buffer[(window_width * y) + x] = 0xFF333333;
+        }
+    }
+}
+
+static void copy_background_rect(SDL_Rect rect)
+{
+    for (int y = rect.y; y < rect.y + rect.h; y++)
+    {
+        memcpy(
+            &color_buffer[(color_buffer_pitch * y) + rect.x],
+            &background_buffer[(window_width * y) + rect.x],
+            rect.w * sizeof(uint32_t));
+    }
+}
+
+// Copy a row with non-temporal stores like fill_row, for restores of the whole frame that
+// would otherwise push everything else out of the cache
+static void stream_row(uint32_t *row, const uint32_t *source, int count)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    while (i < count && ((uintptr_t)(row + i) & 15) != 0)
+    {
+        row[i] = source[i];
+        i++;
+    }
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm_stream_si128((__m128i *)(row + i), _mm_loadu_si128((const __m128i *)(source + i)));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        row[i] = source[i];
+    }
+}
+
+// Change the internal resolution as a fraction of the window size. Buffers are allocated
+// at full window size, so this only changes which part of them we draw into.
+void set_render_scale(float scale)
+{
+    if (scale > 1.0)
+        scale = 1.0;
+    render_scale = scale;
+    render_width = (int)(window_width * scale + 0.5);
+    render_height = (int)(window_height * scale + 0.5);
+    if (render_width < 1)
+        render_width = 1;
+    if (render_height < 1)
+        render_height = 1;
+}
+
+// Copy the background over the regions written since this buffer was last used
+void restore_background(void)
+{
+    // Pixels outside the old render size may hold anything after a resolution change
+    if (color_buffer_dirty->width != render_width || color_buffer_dirty->height != render_height)
+    {
+        color_buffer_dirty->is_full = true;
+    }
+
+    // The locked texture comes back with undefined contents, so in that mode this is every frame
+    if (color_buffer_dirty->is_full)
+    {
+        for (int y = 0; y < render_height; y++)
+        {
+            stream_row(&color_buffer[color_buffer_pitch * y], &background_buffer[window_width * y], render_width);
+        }
+#if defined(__SSE2__)
+        _mm_sfence();
+#endif
+    }
+    else
+    {
+        for (int i = 0; i < color_buffer_dirty->num_rects; i++)
+        {
+            copy_background_rect(color_buffer_dirty->rects[i]);
         }
     }
+
+    color_buffer_dirty->num_rects = 0;
+    color_buffer_dirty->is_full = false;
+    color_buffer_dirty->width = render_width;
+    color_buffer_dirty->height = render_height;
+}
+
+// Record that a rectangle of the color buffer is about to be drawn over.
+// Once all rects are taken, the new one is merged into the rect it grows the least.
+void mark_dirty_rect(int x, int y, int width, int height)
+{
+    int x0 = x < 0 ? 0 : x;
+    int y0 = y < 0 ? 0 : y;
+    int x1 = x + width > render_width ? render_width : x + width;
+    int y1 = y + height > render_height ? render_height : y + height;
+    if (x0 >= x1 || y0 >= y1 || color_buffer_dirty->is_full)
+    {
+        return;
+    }
+
+    dirty_region_t *dirty = color_buffer_dirty;
+    int best_rect = -1;
+    int best_growth = 0;
+    for (int i = 0; i < dirty->num_rects; i++)
+    {
+        SDL_Rect r = dirty->rects[i];
+        int ux0 = r.x < x0 ? r.x : x0;
+        int uy0 = r.y < y0 ? r.y : y0;
+        int ux1 = r.x + r.w > x1 ? r.x + r.w : x1;
+        int uy1 = r.y + r.h > y1 ? r.y + r.h : y1;
+        int growth = (ux1 - ux0) * (uy1 - uy0) - r.w * r.h;
+        if (growth == 0)
+        {
+            // Already covered
+            return;
+        }
+        if (best_rect < 0 || growth < best_growth)
+        {
+            best_rect = i;
+            best_growth = growth;
+        }
+    }
+
+    if (dirty->num_rects < MAX_DIRTY_RECTS)
+    {
+        SDL_Rect rect = { x0, y0, x1 - x0, y1 - y0 };
+        dirty->rects[dirty->num_rects++] = rect;
+        return;
+    }
+
+    SDL_Rect *r = &dirty->rects[best_rect];
+    int ux0 = r->x < x0 ? r->x : x0;
+    int uy0 = r->y < y0 ? r->y : y0;
+    int ux1 = r->x + r->w > x1 ? r->x + r->w : x1;
+    int uy1 = r->y + r->h > y1 ? r->y + r->h : y1;
+    r->x = ux0;
+    r->y = uy0;
+    r->w = ux1 - ux0;
+    r->h = uy1 - uy0;
 }
 
 void draw_pixel(int x, int y, uint32_t color)
 {
-    if(x >= 0 && y >= 0 && x < window_width && y < window_height) {
-        color_buffer[(window_width * y) + x] = color;
+    STAT_ADD(pixels_tested, 1);
+    if(x >= 0 && y >= 0 && x < render_width && y < render_height) {
+        STAT_ADD(pixels_written, 1);
+        color_buffer[(color_buffer_pitch * y) + x] = color;
+        if (heatmap_method != HEATMAP_NONE) {
+            add_heat_span(x, x + 1, y);
+        }
+    }
+}
+
+// Horizontal span from x0 to x1 inclusive. Doesn't mark the dirty region, the caller
+// marks the bounds of the whole primitive instead of every span.
+void draw_hline(int x0, int x1, int y, uint32_t color)
+{
+    if (x1 < x0)
+    {
+        int tmp = x0;
+        x0 = x1;
+        x1 = tmp;
+    }
+    STAT_ADD(pixels_tested, x1 - x0 + 1);
+    if (y < 0 || y >= render_height || x1 < 0 || x0 >= render_width)
+    {
+        return;
+    }
+    if (x0 < 0)
+        x0 = 0;
+    if (x1 >= render_width)
+        x1 = render_width - 1;
+    STAT_ADD(pixels_written, x1 - x0 + 1);
+    if (heatmap_method != HEATMAP_NONE)
+        add_heat_span(x0, x1 + 1, y);
+
+    uint32_t *row = &color_buffer[color_buffer_pitch * y];
+    for (int x = x0; x <= x1; x++)
+    {
+        row[x] = color;
     }
 }
 
 void draw_rect(int x, int y, int width, int height, uint32_t color)
 {
+    mark_dirty_rect(x, y, width, height);
+
     for (int i = 0; i < width; i++)
     {
         for (int j = 0; j < height; j++)
@@ -91,6 +352,10 @@ void draw_line(int x0, int y0, int x1, int y1, uint32_t color) {
 
     int side_length = abs(delta_x) >= abs(delta_y) ? abs(delta_x) : abs(delta_y);
 
+    mark_dirty_rect(
+        (x0 < x1 ? x0 : x1), (y0 < y1 ? y0 : y1),
+        abs(delta_x) + 1, abs(delta_y) + 1);
+
     // How much should we increment per step?
     float x_inc = delta_x / (float)side_length;
     float y_inc = delta_y / (float)side_length;
@@ -105,30 +370,67 @@ void draw_line(int x0, int y0, int x1, int y1, uint32_t color) {
     }
 }
 
-void render_color_buffer(void)
+// Point color_buffer at the memory we are going to rasterize into for this frame.
+// In PRESENT_LOCKED_TEXTURE mode that is the streaming texture itself, which saves
+// copying the whole frame with SDL_UpdateTexture. Only the render area is locked, so
+// only it is uploaded on unlock. The locked pixels are write-only and their previous
+// contents are undefined, so the frame must be cleared after this.
+void lock_color_buffer(void)
 {
-    SDL_UpdateTexture(
-        color_buffer_texture,
-        NULL,
-        color_buffer,
-        (int)(window_width * sizeof(uint32_t)));
-    SDL_RenderCopy(renderer, color_buffer_texture, NULL, NULL);
+    if (present_mode == PRESENT_LOCKED_TEXTURE)
+    {
+        SDL_Rect render_rect = { 0, 0, render_width, render_height };
+        void *pixels;
+        int pitch;
+        if (SDL_LockTexture(color_buffer_texture, &render_rect, &pixels, &pitch) == 0)
+        {
+            color_buffer = (uint32_t *)pixels;
+            color_buffer_pitch = pitch / (int)sizeof(uint32_t);
+            color_buffer_dirty = &texture_dirty;
+            texture_dirty.is_full = true;
+            is_texture_locked = true;
+            return;
+        }
+
+        // Some drivers can't lock streaming textures, keep using the back buffer from now on
+        fprintf(stderr, "Error locking color buffer texture, falling back to copy: %s \n", SDL_GetError());
+        present_mode = PRESENT_COPY;
+    }
+
+    color_buffer = back_buffer;
+    color_buffer_pitch = window_width;
+    color_buffer_dirty = &back_buffer_dirty;
 }
 
-void clear_color_buffer(uint32_t color)
+void render_color_buffer(void)
 {
-    for (int y = 0; y < window_height; y++)
+    // Only the part we rendered into is uploaded, SDL scales it up to the window
+    SDL_Rect render_rect = { 0, 0, render_width, render_height };
+
+    if (is_texture_locked)
     {
-        for (int x = 0; x < window_width; x++)
-        {
-            color_buffer[(window_width * y) + x] = color;
-        }
+        SDL_UnlockTexture(color_buffer_texture);
+        is_texture_locked = false;
+    }
+    else
+    {
+        SDL_UpdateTexture(
+            color_buffer_texture,
+            &render_rect,
+            color_buffer,
+            (int)(color_buffer_pitch * sizeof(uint32_t)));
     }
+    // Either way the texture receives the render area and nothing else
+    STAT_ADD(bytes_uploaded, (int64_t)render_rect.w * render_rect.h * sizeof(uint32_t));
+    SDL_RenderCopy(renderer, color_buffer_texture, &render_rect, NULL);
 }
 
 void destroy_window(void)
 {
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
+    free(background_buffer);
+    if (renderer)
+        SDL_DestroyRenderer(renderer);
+    if (window)
+        SDL_DestroyWindow(window);
     SDL_Quit();
 }
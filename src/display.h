@@ -4,25 +4,57 @@
 #include <stdint.h>
 #include <SDL2/SDL.h>
 
-#define FPS 60
-#define FRAME_TARGET_TIME (1000 / FPS)
+extern bool is_headless;
 
 extern SDL_Window *window;
 extern SDL_Renderer *renderer;
 
+enum present_mode {
+    PRESENT_COPY,           // Rasterize into a malloc'd back buffer and upload it with SDL_UpdateTexture
+    PRESENT_LOCKED_TEXTURE  // Rasterize straight into the pixels of the locked streaming texture
+};
+
+extern enum present_mode present_mode;
+
+#define MAX_DIRTY_RECTS 16
+
+// Bounding rectangles written to a color buffer since its background was last restored
+typedef struct {
+    SDL_Rect rects[MAX_DIRTY_RECTS];
+    int num_rects;
+    bool is_full; // Contents are unknown, the whole buffer has to be restored
+    int width;    // Render size the background was last restored at
+    int height;
+} dirty_region_t;
+
 extern uint32_t *color_buffer;
+extern uint32_t *back_buffer;
+extern int color_buffer_pitch;
+extern dirty_region_t *color_buffer_dirty;
+extern uint32_t *background_buffer;
 extern SDL_Texture *color_buffer_texture;
 
 extern int window_width;
 extern int window_height;
 
+extern int render_width;
+extern int render_height;
+extern float render_scale;
+
 bool initialize_window(void);
+bool initialize_headless(int width, int height);
 void destroy_window(void);
 
+void set_render_scale(float scale);
+
+void lock_color_buffer(void);
 void render_color_buffer(void);
-void clear_color_buffer(uint32_t color);
 
-void draw_grid(void);
+void init_background(uint32_t color);
+void restore_background(void);
+void mark_dirty_rect(int x, int y, int width, int height);
+
 void draw_pixel(int x, int y, uint32_t color);
+void draw_hline(int x0, int x1, int y, uint32_t color);
 void draw_rect(int x, int y, int width, int height, uint32_t color);
 void draw_line(int x0, int y0, int x1, int y1, uint32_t color);
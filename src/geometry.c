@@ -0,0 +1,593 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "geometry.h"
+#include "array.h"
+#include "display.h"
+#include "light.h"
+#include "clipping.h"
+#include "lod.h"
+#include "occlusion.h"
+#include "shadow.h"
+#include "stats.h"
+#include "bench.h"
+
+enum cull_method cull_method = CULL_BACKFACE;
+enum shading_method shading_method = SHADING_FLAT;
+
+triangle_t *triangles_to_render = NULL;
+
+mat4_t projection_matrix;
+mat4_t view_matrix;
+
+///////////////////////////////////////////////////////////////////////////////
+// Instanced vertex stage
+///////////////////////////////////////////////////////////////////////////////
+// The model-view matrices of a chunk of instances are stored transposed, one
+// array per matrix element, and the transformed vertices are stored the same
+// way, one lane per instance:
+//
+//   view_x: [ v0 i0, v0 i1, ... v0 i15 | v1 i0, v1 i1, ... v1 i15 | ... ]
+//
+// Every mesh vertex is loaded once per chunk and the inner loop over the
+// instances runs on contiguous floats, so the compiler can vectorize it. The
+// mesh itself is never copied, memory only grows with the vertex count.
+//
+// Back faces are rejected before that, in object space: the camera position
+// is taken into each instance's object space once and every face is tested
+// with one dot product against its precomputed plane. Only the vertices of
+// faces that survive in at least one lane get transformed, and with Gouraud
+// shading only their normals get lit, once per unique normal and lane.
+///////////////////////////////////////////////////////////////////////////////
+static float model_view[12][INSTANCE_CHUNK_SIZE];
+// Frustum planes in the object space of each lane's instance
+static plane_equation_t lane_planes[INSTANCE_CHUNK_SIZE][NUM_PLANES];
+static int *visible_clusters = NULL;
+// Level of detail of each lane's instance
+static int lane_lods[INSTANCE_CHUNK_SIZE];
+// Camera position in the object space of each lane's instance
+static vec3_t lane_eyes[INSTANCE_CHUNK_SIZE];
+// Inverse transpose of each lane's model-view rotation and scale, takes normals to view space.
+// Stored like model_view, one array per matrix element.
+static float normal_matrix[9][INSTANCE_CHUNK_SIZE];
+static float *view_x = NULL;
+static float *view_y = NULL;
+static float *view_z = NULL;
+static int view_vertices_capacity = 0;
+
+// Front faces of every lane, lane i owns visible_faces[lane_first_face[i] .. lane_first_face[i + 1]]
+static const face_t **visible_faces = NULL;
+static int num_visible_faces = 0;
+static int visible_faces_capacity = 0;
+static int lane_first_face[INSTANCE_CHUNK_SIZE + 1];
+
+// Vertices used by any visible face of the chunk, vertex_marks[v] == mark_stamp when v is listed
+static int *needed_vertices = NULL;
+static int num_needed_vertices = 0;
+static int *vertex_marks = NULL;
+static int mark_stamp = 0;
+
+// Same for the vertex normals, with the view space normal and light intensity of each one per lane
+static int *needed_normals = NULL;
+static int num_needed_normals = 0;
+static int *normal_marks = NULL;
+static float *normal_intensity = NULL;
+static float *normal_view_x = NULL;
+static float *normal_view_y = NULL;
+static float *normal_view_z = NULL;
+static int normals_capacity = 0;
+
+static void reserve_vertex_buffers(int num_vertices)
+{
+    if (num_vertices > view_vertices_capacity)
+    {
+        view_vertices_capacity = num_vertices;
+        size_t size = sizeof(float) * INSTANCE_CHUNK_SIZE * num_vertices;
+        view_x = (float *)realloc(view_x, size);
+        view_y = (float *)realloc(view_y, size);
+        view_z = (float *)realloc(view_z, size);
+        needed_vertices = (int *)realloc(needed_vertices, sizeof(int) * num_vertices);
+        vertex_marks = (int *)realloc(vertex_marks, sizeof(int) * num_vertices);
+        memset(vertex_marks, 0, sizeof(int) * num_vertices);
+    }
+}
+
+static void reserve_normal_buffers(int num_normals)
+{
+    if (num_normals > normals_capacity)
+    {
+        normals_capacity = num_normals;
+        size_t size = sizeof(float) * INSTANCE_CHUNK_SIZE * num_normals;
+        normal_intensity = (float *)realloc(normal_intensity, size);
+        normal_view_x = (float *)realloc(normal_view_x, size);
+        normal_view_y = (float *)realloc(normal_view_y, size);
+        normal_view_z = (float *)realloc(normal_view_z, size);
+        needed_normals = (int *)realloc(needed_normals, sizeof(int) * num_normals);
+        normal_marks = (int *)realloc(normal_marks, sizeof(int) * num_normals);
+        memset(normal_marks, 0, sizeof(int) * num_normals);
+    }
+}
+
+static void mark_normal(int index)
+{
+    if (normal_marks[index] != mark_stamp)
+    {
+        normal_marks[index] = mark_stamp;
+        needed_normals[num_needed_normals++] = index;
+    }
+}
+
+static void mark_vertex(int index)
+{
+    if (vertex_marks[index] != mark_stamp)
+    {
+        vertex_marks[index] = mark_stamp;
+        needed_vertices[num_needed_vertices++] = index;
+    }
+}
+
+// Transform every needed vertex in the first count lanes, the rest of the chunk is left as it was
+static void transform_vertices(const mesh_t *mesh, int count)
+{
+    for (int n = 0; n < num_needed_vertices; n++)
+    {
+        int v = needed_vertices[n];
+        vec3_t p = mesh->vertices[v];
+        float *out_x = &view_x[v * INSTANCE_CHUNK_SIZE];
+        float *out_y = &view_y[v * INSTANCE_CHUNK_SIZE];
+        float *out_z = &view_z[v * INSTANCE_CHUNK_SIZE];
+        for (int i = 0; i < count; i++)
+        {
+            out_x[i] = model_view[0][i] * p.x + model_view[1][i] * p.y + model_view[2][i] * p.z + model_view[3][i];
+            out_y[i] = model_view[4][i] * p.x + model_view[5][i] * p.y + model_view[6][i] * p.z + model_view[7][i];
+            out_z[i] = model_view[8][i] * p.x + model_view[9][i] * p.y + model_view[10][i] * p.z + model_view[11][i];
+        }
+    }
+}
+
+// Light every needed normal in the first count lanes at once, with the same layout as the vertex transform
+static void light_normals(const mesh_t *mesh, int count)
+{
+    for (int n = 0; n < num_needed_normals; n++)
+    {
+        int index = needed_normals[n];
+        vec3_t normal = mesh->normals[index];
+        float *out = &normal_intensity[index * INSTANCE_CHUNK_SIZE];
+        float *out_x = &normal_view_x[index * INSTANCE_CHUNK_SIZE];
+        float *out_y = &normal_view_y[index * INSTANCE_CHUNK_SIZE];
+        float *out_z = &normal_view_z[index * INSTANCE_CHUNK_SIZE];
+        for (int i = 0; i < count; i++)
+        {
+            float x = normal_matrix[0][i] * normal.x + normal_matrix[1][i] * normal.y + normal_matrix[2][i] * normal.z;
+            float y = normal_matrix[3][i] * normal.x + normal_matrix[4][i] * normal.y + normal_matrix[5][i] * normal.z;
+            float z = normal_matrix[6][i] * normal.x + normal_matrix[7][i] * normal.y + normal_matrix[8][i] * normal.z;
+            float length = sqrtf(x * x + y * y + z * z);
+            float inv_length = length > 0 ? 1 / length : 1;
+            out_x[i] = x * inv_length;
+            out_y[i] = y * inv_length;
+            out_z[i] = z * inv_length;
+            float intensity = -(out_x[i] * light.direction.x + out_y[i] * light.direction.y + out_z[i] * light.direction.z);
+            out[i] = intensity < 0 ? 0 : intensity;
+        }
+    }
+}
+
+static vec4_t view_vertex(int index, int lane)
+{
+    vec4_t result = {
+        view_x[index * INSTANCE_CHUNK_SIZE + lane],
+        view_y[index * INSTANCE_CHUNK_SIZE + lane],
+        view_z[index * INSTANCE_CHUNK_SIZE + lane],
+        1.0
+    };
+    return result;
+}
+
+// Invert the rotation and scale part of the model-view matrix to get the camera
+// (the view space origin) and the normal matrix in the instance's object space
+static void set_lane_camera(int lane, mat4_t mv)
+{
+    float (*m)[4] = mv.m;
+    float inverse[3][3] = {
+        { m[1][1] * m[2][2] - m[1][2] * m[2][1], m[0][2] * m[2][1] - m[0][1] * m[2][2], m[0][1] * m[1][2] - m[0][2] * m[1][1] },
+        { m[1][2] * m[2][0] - m[1][0] * m[2][2], m[0][0] * m[2][2] - m[0][2] * m[2][0], m[0][2] * m[1][0] - m[0][0] * m[1][2] },
+        { m[1][0] * m[2][1] - m[1][1] * m[2][0], m[0][1] * m[2][0] - m[0][0] * m[2][1], m[0][0] * m[1][1] - m[0][1] * m[1][0] }
+    };
+    float det = m[0][0] * inverse[0][0] + m[0][1] * inverse[1][0] + m[0][2] * inverse[2][0];
+    for (int row = 0; row < 3; row++)
+    {
+        for (int col = 0; col < 3; col++)
+        {
+            inverse[row][col] /= det;
+            normal_matrix[col * 3 + row][lane] = inverse[row][col];
+        }
+    }
+
+    vec3_t eye = {
+        -(inverse[0][0] * m[0][3] + inverse[0][1] * m[1][3] + inverse[0][2] * m[2][3]),
+        -(inverse[1][0] * m[0][3] + inverse[1][1] * m[1][3] + inverse[1][2] * m[2][3]),
+        -(inverse[2][0] * m[0][3] + inverse[2][1] * m[1][3] + inverse[2][2] * m[2][3])
+    };
+    lane_eyes[lane] = eye;
+}
+
+// Keep the faces of a range that look towards the camera and mark their vertices for the transform
+static void cull_face_range(const face_t *faces, int lane, int first_face, int n_faces)
+{
+    if (num_visible_faces + n_faces > visible_faces_capacity)
+    {
+        visible_faces_capacity = (num_visible_faces + n_faces) * 2;
+        visible_faces = (const face_t **)realloc(visible_faces, sizeof(face_t *) * visible_faces_capacity);
+    }
+
+    vec3_t eye = lane_eyes[lane];
+    for (int i = first_face; i < first_face + n_faces; i++)
+    {
+        const face_t *face = &faces[i];
+
+        // Bypass the faces whose plane has the camera behind it
+        if (cull_method == CULL_BACKFACE && vec3_dot(face->normal, eye) + face->plane_d < 0)
+        {
+            STAT_ADD(faces_backface_culled, 1);
+            continue;
+        }
+
+        visible_faces[num_visible_faces++] = face;
+        mark_vertex(face->a);
+        mark_vertex(face->b);
+        mark_vertex(face->c);
+        if (shading_method == SHADING_GOURAUD)
+        {
+            mark_normal(face->a_vn);
+            mark_normal(face->b_vn);
+            mark_normal(face->c_vn);
+        }
+    }
+}
+
+// Faces of the whole mesh, or only of the clusters that reach into the frustum and face the camera when the mesh has them.
+// Simplified levels are small enough to go through whole.
+static void cull_faces(mesh_t *mesh, int lane)
+{
+    if (lane_lods[lane] > 0)
+    {
+        face_t *faces = mesh_lod_faces(mesh, lane_lods[lane]);
+        STAT_ADD(faces_processed, array_length(faces));
+        cull_face_range(faces, lane, 0, array_length(faces));
+        return;
+    }
+
+    STAT_ADD(faces_processed, array_length(mesh->faces));
+    if (mesh->clusters.num_nodes == 0)
+    {
+        cull_face_range(mesh->faces, lane, 0, array_length(mesh->faces));
+        return;
+    }
+
+    array_free(visible_clusters);
+    visible_clusters = NULL;
+    bvh_query_frustum(&mesh->clusters, lane_planes[lane], &visible_clusters);
+
+    int n_clusters = array_length(visible_clusters);
+    int n_culled_faces = array_length(mesh->faces);
+    for (int i = 0; i < n_clusters; i++)
+    {
+        bvh_node_t *cluster = &mesh->clusters.nodes[visible_clusters[i]];
+        n_culled_faces -= cluster->count;
+
+        // Clusters facing away as a whole skip the per-face test
+        if (cull_method == CULL_BACKFACE && is_cluster_backfacing(&mesh->cluster_bounds[visible_clusters[i]], lane_eyes[lane]))
+        {
+            STAT_ADD(faces_backface_culled, cluster->count);
+            continue;
+        }
+        cull_face_range(mesh->faces, lane, cluster->left_first, cluster->count);
+    }
+    STAT_ADD(faces_frustum_culled, n_culled_faces);
+}
+
+// Project and light a front face of the instance in the given lane of the last transform
+static void process_face(const face_t *face, texture_t *texture, int lane)
+{
+    face_t mesh_face = *face;
+
+    // Vertices were already transformed into view space for this instance
+    vec4_t transformed_vertices[3] = {
+        view_vertex(mesh_face.a, lane),
+        view_vertex(mesh_face.b, lane),
+        view_vertex(mesh_face.c, lane)
+    };
+
+
+    vec4_t projected_vertices[3];
+
+    // Loop all three vertices to perform projection
+    for (int j = 0; j < 3; j++) {
+        // Project the current vertex
+        projected_vertices[j] = mat4_mul_vec4_project(projection_matrix, transformed_vertices[j]);
+
+        // Scale into the viewport
+        projected_vertices[j].x *= (render_width / 2);
+        projected_vertices[j].y *= (render_height / 2);
+
+        // Invert the y values to account for the screen y-axis growing downwards
+        projected_vertices[j].y *= -1;
+
+        // Translate the projected points to the middle of the screen
+        projected_vertices[j].x += (render_width / 2);
+        projected_vertices[j].y += (render_height / 2);
+    }
+
+#if ENABLE_STATS
+    for (int j = 0; j < 3; j++)
+    {
+        if (projected_vertices[j].x < 0 || projected_vertices[j].x >= render_width || projected_vertices[j].y < 0 || projected_vertices[j].y >= render_height)
+        {
+            STAT_ADD(faces_clipped, 1);
+            break;
+        }
+    }
+#endif
+
+    float avg_depth = (transformed_vertices[0].z + transformed_vertices[1].z + transformed_vertices[2].z) / 3;
+
+    // The color stays unlit here, flat shading bakes it once the local lights are added
+    float intensities[3];
+    vec3_t normals[3];
+    if (shading_method == SHADING_GOURAUD)
+    {
+        int corners[3] = { mesh_face.a_vn, mesh_face.b_vn, mesh_face.c_vn };
+        for (int j = 0; j < 3; j++)
+        {
+            int index = corners[j] * INSTANCE_CHUNK_SIZE + lane;
+            intensities[j] = normal_intensity[index];
+            normals[j] = vec3_new(normal_view_x[index], normal_view_y[index], normal_view_z[index]);
+        }
+    }
+    else
+    {
+        // Take the precomputed face normal to view space for the lighting
+        vec3_t normal = {
+            normal_matrix[0][lane] * mesh_face.normal.x + normal_matrix[1][lane] * mesh_face.normal.y + normal_matrix[2][lane] * mesh_face.normal.z,
+            normal_matrix[3][lane] * mesh_face.normal.x + normal_matrix[4][lane] * mesh_face.normal.y + normal_matrix[5][lane] * mesh_face.normal.z,
+            normal_matrix[6][lane] * mesh_face.normal.x + normal_matrix[7][lane] * mesh_face.normal.y + normal_matrix[8][lane] * mesh_face.normal.z
+        };
+        vec3_normalize(&normal);
+
+        float light_intensity_factor = -vec3_dot(normal, light.direction);
+        float flat_intensity = light_intensity_factor < 0 ? 0 : light_intensity_factor;
+        intensities[0] = intensities[1] = intensities[2] = flat_intensity;
+        normals[0] = normals[1] = normals[2] = normal;
+    }
+
+    // Shadows only take away the directional light, the local ones are added on top later
+    if (is_shadow_mapping)
+    {
+        if (shading_method == SHADING_GOURAUD)
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                intensities[j] *= shadow_factor(vec3_from_vec4(transformed_vertices[j]), normals[j]);
+            }
+        }
+        else
+        {
+            vec3_t center = vec3_div(vec3_add(vec3_from_vec4(transformed_vertices[0]), vec3_add(vec3_from_vec4(transformed_vertices[1]), vec3_from_vec4(transformed_vertices[2]))), 3);
+            float shadow = shadow_factor(center, normals[0]);
+            intensities[0] = intensities[1] = intensities[2] = intensities[0] * shadow;
+        }
+    }
+
+    triangle_t projected_triangle = {
+        .vertices = {
+            { projected_vertices[0].x, projected_vertices[0].y, projected_vertices[0].z,  projected_vertices[0].w },
+            { projected_vertices[1].x, projected_vertices[1].y, projected_vertices[1].z,  projected_vertices[1].w },
+            { projected_vertices[2].x, projected_vertices[2].y, projected_vertices[2].z,  projected_vertices[2].w }
+        },
+        .texcoords = {
+            { mesh_face.a_uv.u, mesh_face.a_uv.v },
+            { mesh_face.b_uv.u, mesh_face.b_uv.v },
+            { mesh_face.c_uv.u, mesh_face.c_uv.v },
+        },
+        .intensities = { intensities[0], intensities[1], intensities[2] },
+        .normals = { normals[0], normals[1], normals[2] },
+        .color = mesh_face.color,
+        .avg_depth = avg_depth,
+        .texture = texture
+    };
+
+    array_push(triangles_to_render, projected_triangle);
+}
+
+// Cheap whole-object test before any per-face work: the bounding sphere first,
+// then the tighter box if the sphere straddles a plane
+static bool is_instance_visible(const mesh_t *mesh, mat4_t model_view, plane_equation_t planes[NUM_PLANES])
+{
+    frustum_planes_to_object_space(model_view, planes);
+
+    if (!sphere_in_frustum(planes, mesh->sphere_center, mesh->sphere_radius))
+    {
+        return false;
+    }
+    return aabb_in_frustum(planes, mesh->aabb_min, mesh->aabb_max);
+}
+
+// Radius of the mesh's bounding sphere on screen, in pixels
+float mesh_screen_radius(const mesh_t *mesh, mat4_t model_view)
+{
+    vec4_t center = mat4_mul_vec4(model_view, vec4_from_vec3(mesh->sphere_center));
+
+    // Largest axis scale of the instance, the sphere has to cover the mesh when stretched
+    float scale = 0;
+    for (int col = 0; col < 3; col++)
+    {
+        vec3_t axis = { model_view.m[0][col], model_view.m[1][col], model_view.m[2][col] };
+        float length = vec3_length(axis);
+        scale = length > scale ? length : scale;
+    }
+    float radius = mesh->sphere_radius * scale;
+
+    // Camera inside the sphere, it covers the whole screen
+    if (center.z <= radius)
+    {
+        return render_height;
+    }
+    return radius * projection_matrix.m[1][1] * (render_height / 2) / center.z;
+}
+
+// Cull, transform and process the faces of the first count lanes of model_view
+static void flush_instance_chunk(mesh_t *mesh, texture_t *texture, int count)
+{
+    reserve_vertex_buffers(array_length(mesh->vertices));
+    reserve_normal_buffers(array_length(mesh->normals));
+    mark_stamp++;
+    num_needed_vertices = 0;
+    num_needed_normals = 0;
+    num_visible_faces = 0;
+    bench_begin_stage(STAGE_CULL);
+    for (int i = 0; i < count; i++)
+    {
+        lane_first_face[i] = num_visible_faces;
+        cull_faces(mesh, i);
+    }
+    lane_first_face[count] = num_visible_faces;
+    bench_end_stage(STAGE_CULL);
+
+    transform_vertices(mesh, count);
+    if (shading_method == SHADING_GOURAUD)
+    {
+        light_normals(mesh, count);
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        for (int f = lane_first_face[i]; f < lane_first_face[i + 1]; f++)
+        {
+            process_face(visible_faces[f], texture, i);
+        }
+    }
+}
+
+// Draw num_instances copies of a mesh, one per world matrix, sharing the mesh's vertices and faces.
+// Instances outside the view frustum are dropped before they take a lane in the vertex loop.
+// When the mesh has simplified levels, lods holds each instance's level from the last frame and
+// is updated with the one drawn now.
+void draw_mesh_instanced(mesh_t *mesh, texture_t *texture, const mat4_t *world_matrices, int *lods, int num_instances)
+{
+    int count = 0;
+    for (int i = 0; i < num_instances; i++)
+    {
+        mat4_t mv = mat4_mul_mat4(view_matrix, world_matrices[i]);
+        bench_begin_stage(STAGE_CULL);
+        bool is_visible = is_instance_visible(mesh, mv, lane_planes[count]);
+        bool is_hidden = is_visible && is_occlusion_culling && is_occluded(mesh, mv, projection_matrix);
+        bench_end_stage(STAGE_CULL);
+        if (!is_visible)
+        {
+            STAT_ADD(faces_processed, array_length(mesh->faces));
+            STAT_ADD(faces_frustum_culled, array_length(mesh->faces));
+            continue;
+        }
+        if (is_hidden)
+        {
+            STAT_ADD(faces_processed, array_length(mesh->faces));
+            STAT_ADD(faces_occlusion_culled, array_length(mesh->faces));
+            continue;
+        }
+
+        for (int row = 0; row < 3; row++)
+        {
+            for (int col = 0; col < 4; col++)
+            {
+                model_view[row * 4 + col][count] = mv.m[row][col];
+            }
+        }
+
+        set_lane_camera(count, mv);
+
+        lane_lods[count] = 0;
+        if (lods != NULL && mesh->num_lods > 1)
+        {
+            lods[i] = select_mesh_lod(mesh, lods[i], mesh_screen_radius(mesh, mv));
+            lane_lods[count] = lods[i];
+        }
+
+        count++;
+        if (count == INSTANCE_CHUNK_SIZE)
+        {
+            flush_instance_chunk(mesh, texture, count);
+            count = 0;
+        }
+    }
+
+    if (count > 0)
+    {
+        flush_instance_chunk(mesh, texture, count);
+    }
+}
+
+// Draw the instances of a mesh that are in the frustum and large on screen into the occlusion buffer
+void draw_mesh_occluders(const mesh_t *mesh, const mat4_t *world_matrices, int num_instances)
+{
+    plane_equation_t planes[NUM_PLANES];
+    for (int i = 0; i < num_instances; i++)
+    {
+        mat4_t mv = mat4_mul_mat4(view_matrix, world_matrices[i]);
+        if (is_instance_visible(mesh, mv, planes) && mesh_screen_radius(mesh, mv) >= occluder_min_radius)
+        {
+            draw_occluder(mesh, mv, projection_matrix);
+        }
+    }
+}
+
+// Every instance casts shadows, including the ones outside the view frustum
+void draw_mesh_shadow_casters(const mesh_t *mesh, const mat4_t *world_matrices, int num_instances)
+{
+    for (int i = 0; i < num_instances; i++)
+    {
+        draw_shadow_caster(mesh, mat4_mul_mat4(view_matrix, world_matrices[i]));
+    }
+}
+
+// Transform, cull and project the faces of one mesh instance into triangles_to_render
+void process_instance(instance_t *instance)
+{
+    mesh_t *mesh = &scene.meshes[instance->mesh];
+    texture_t *texture = instance->texture >= 0 ? &scene.textures[instance->texture] : NULL;
+
+    mat4_t world_matrix = scene_instance_world_matrix(instance);
+    draw_mesh_instanced(mesh, texture, &world_matrix, &instance->lod, 1);
+}
+
+void free_geometry(void)
+{
+    free(view_x);
+    free(view_y);
+    free(view_z);
+    view_x = NULL;
+    view_y = NULL;
+    view_z = NULL;
+    view_vertices_capacity = 0;
+    free(needed_vertices);
+    free(vertex_marks);
+    needed_vertices = NULL;
+    vertex_marks = NULL;
+    free(visible_faces);
+    visible_faces = NULL;
+    free(needed_normals);
+    free(normal_marks);
+    free(normal_intensity);
+    free(normal_view_x);
+    free(normal_view_y);
+    free(normal_view_z);
+    normal_view_x = NULL;
+    normal_view_y = NULL;
+    normal_view_z = NULL;
+    needed_normals = NULL;
+    normal_marks = NULL;
+    normal_intensity = NULL;
+    normals_capacity = 0;
+    visible_faces_capacity = 0;
+    array_free(visible_clusters);
+    visible_clusters = NULL;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "matrix.h"
+#include "mesh.h"
+#include "scene.h"
+#include "texture.h"
+#include "triangle.h"
+
+// Number of instances whose vertices are transformed together in one pass over the mesh
+#define INSTANCE_CHUNK_SIZE 16
+
+enum cull_method {
+    CULL_NONE,
+    CULL_BACKFACE
+};
+
+extern enum cull_method cull_method;
+
+enum shading_method {
+    SHADING_FLAT,     // One light intensity per face, baked into the triangle color
+    SHADING_GOURAUD   // One per vertex normal, interpolated by the rasterizer
+};
+
+extern enum shading_method shading_method;
+
+extern triangle_t *triangles_to_render;
+
+extern mat4_t projection_matrix;
+extern mat4_t view_matrix;
+
+void process_instance(instance_t *instance);
+void draw_mesh_instanced(mesh_t *mesh, texture_t *texture, const mat4_t *world_matrices, int *lods, int num_instances);
+void draw_mesh_occluders(const mesh_t *mesh, const mat4_t *world_matrices, int num_instances);
+void draw_mesh_shadow_casters(const mesh_t *mesh, const mat4_t *world_matrices, int num_instances);
+float mesh_screen_radius(const mesh_t *mesh, mat4_t model_view);
+void free_geometry(void);
@@ -0,0 +1,136 @@
+#include <stdlib.h>
+#include <string.h>
+#include "heatmap.h"
+#include "display.h"
+#include "pacing.h"
+
+enum heatmap_method heatmap_method = HEATMAP_NONE;
+
+static int heat_width = 0;
+static int heat_height = 0;
+static int heat_capacity = 0;
+static uint16_t *overdraw = NULL;
+static int *pixel_triangle = NULL;
+
+// Seconds spent on every triangle of the frame, and the one being drawn now
+static float *triangle_costs = NULL;
+static int triangle_capacity = 0;
+static int current_triangle = -1;
+static double triangle_start_time = 0;
+
+// Black, blue, cyan, green, yellow, red, white
+static const uint32_t heat_ramp[] = { 0xFF000000, 0xFF0000FF, 0xFF00FFFF, 0xFF00FF00, 0xFFFFFF00, 0xFFFF0000, 0xFFFFFFFF };
+#define NUM_HEAT_COLORS ((int)(sizeof(heat_ramp) / sizeof(heat_ramp[0])))
+
+void begin_heatmap(enum heatmap_method method, int num_triangles) {
+    if (render_width * render_height > heat_capacity) {
+        heat_capacity = render_width * render_height;
+        overdraw = (uint16_t *)realloc(overdraw, sizeof(uint16_t) * heat_capacity);
+        pixel_triangle = (int *)realloc(pixel_triangle, sizeof(int) * heat_capacity);
+    }
+    if (num_triangles > triangle_capacity) {
+        triangle_capacity = num_triangles;
+        triangle_costs = (float *)realloc(triangle_costs, sizeof(float) * triangle_capacity);
+    }
+    heat_width = render_width;
+    heat_height = render_height;
+
+    if (method == HEATMAP_OVERDRAW) {
+        memset(overdraw, 0, sizeof(uint16_t) * heat_width * heat_height);
+    } else {
+        memset(pixel_triangle, 0xFF, sizeof(int) * heat_width * heat_height);
+    }
+    current_triangle = -1;
+    heatmap_method = method;
+}
+
+void begin_heat_triangle(int index) {
+    current_triangle = index;
+    triangle_start_time = get_time_seconds();
+}
+
+void end_heat_triangle(void) {
+    if (current_triangle >= 0 && current_triangle < triangle_capacity) {
+        triangle_costs[current_triangle] = get_time_seconds() - triangle_start_time;
+    }
+    current_triangle = -1;
+}
+
+// Pixels x_start to x_end - 1 of row y were just written, already clipped to the render area
+void add_heat_span(int x_start, int x_end, int y) {
+    int offset = y * heat_width;
+    if (heatmap_method == HEATMAP_OVERDRAW) {
+        for (int x = x_start; x < x_end; x++) {
+            if (overdraw[offset + x] < UINT16_MAX) {
+                overdraw[offset + x]++;
+            }
+        }
+    } else {
+        for (int x = x_start; x < x_end; x++) {
+            pixel_triangle[offset + x] = current_triangle;
+        }
+    }
+}
+
+// t from 0 to 1 along the ramp
+static uint32_t heat_color(float t) {
+    if (t <= 0) {
+        return heat_ramp[0];
+    }
+    if (t >= 1) {
+        return heat_ramp[NUM_HEAT_COLORS - 1];
+    }
+    float position = t * (NUM_HEAT_COLORS - 1);
+    int index = (int)position;
+    float blend = position - index;
+    uint32_t from = heat_ramp[index];
+    uint32_t to = heat_ramp[index + 1];
+
+    uint32_t color = 0xFF000000;
+    for (int shift = 0; shift <= 16; shift += 8) {
+        float channel = ((from >> shift) & 0xFF) * (1 - blend) + ((to >> shift) & 0xFF) * blend;
+        color |= (uint32_t)(channel + 0.5) << shift;
+    }
+    return color;
+}
+
+void draw_heatmap(void) {
+    enum heatmap_method method = heatmap_method;
+    // Whatever is drawn from here on, like the HUD, is not part of the heatmap
+    heatmap_method = HEATMAP_NONE;
+
+    float max_cost = 0;
+    if (method == HEATMAP_COST) {
+        for (int i = 0; i < heat_width * heat_height; i++) {
+            int triangle = pixel_triangle[i];
+            if (triangle >= 0 && triangle_costs[triangle] > max_cost) {
+                max_cost = triangle_costs[triangle];
+            }
+        }
+    }
+
+    for (int y = 0; y < heat_height; y++) {
+        uint32_t *row = &color_buffer[color_buffer_pitch * y];
+        int offset = y * heat_width;
+        for (int x = 0; x < heat_width; x++) {
+            if (method == HEATMAP_OVERDRAW) {
+                row[x] = heat_color((float)overdraw[offset + x] / HEATMAP_MAX_OVERDRAW);
+            } else {
+                int triangle = pixel_triangle[offset + x];
+                row[x] = triangle >= 0 && max_cost > 0 ? heat_color(triangle_costs[triangle] / max_cost) : heat_ramp[0];
+            }
+        }
+    }
+    mark_dirty_rect(0, 0, heat_width, heat_height);
+}
+
+void free_heatmap(void) {
+    free(overdraw);
+    free(pixel_triangle);
+    free(triangle_costs);
+    overdraw = NULL;
+    pixel_triangle = NULL;
+    triangle_costs = NULL;
+    heat_capacity = 0;
+    triangle_capacity = 0;
+}
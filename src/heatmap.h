@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Heatmaps
+///////////////////////////////////////////////////////////////////////////////
+// While a heatmap is being drawn, draw_pixel, draw_hline and the rasterizer
+// spans also write to a side buffer the size of the render area:
+//
+//   overdraw  how many times every pixel was written this frame
+//   cost      the time spent rasterizing the triangle that wrote it last,
+//             which is the one left on screen in painter's order
+//
+// draw_heatmap() then replaces the frame with those values on a color ramp,
+// from black (nothing) over blue and green to red and white (most). Overdraw
+// moves one color per write and is white from 6 on, cost is relative to the
+// slowest triangle on screen.
+///////////////////////////////////////////////////////////////////////////////
+enum heatmap_method {
+    HEATMAP_NONE,
+    HEATMAP_OVERDRAW,
+    HEATMAP_COST
+};
+
+// The side buffer is only written while this is not HEATMAP_NONE
+extern enum heatmap_method heatmap_method;
+
+#define HEATMAP_MAX_OVERDRAW 6
+
+void begin_heatmap(enum heatmap_method method, int num_triangles);
+void begin_heat_triangle(int index);
+void end_heat_triangle(void);
+void add_heat_span(int x_start, int x_end, int y);
+void draw_heatmap(void);
+void free_heatmap(void);
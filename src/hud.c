@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "hud.h"
+#include "stats.h"
+#include "display.h"
+
+bool is_hud_visible = false;
+
+///////////////////////////////////////////////////////////////////////////////
+// A 3x5 pixel font, one row per digit: bit 4 is the left pixel, bit 1 the
+// right one. Glyphs are expanded once into a cache of ready scaled pixels, 0
+// where transparent, so drawing text is copying rows of it.
+///////////////////////////////////////////////////////////////////////////////
+#define GLYPH_WIDTH 3
+#define GLYPH_HEIGHT 5
+#define GLYPH_SCALE 2
+#define CELL_WIDTH ((GLYPH_WIDTH + 1) * GLYPH_SCALE)
+#define CELL_HEIGHT ((GLYPH_HEIGHT + 2) * GLYPH_SCALE)
+#define HUD_COLOR 0xFF40FF40
+#define HUD_BACKGROUND 0xFF000000
+
+static const char glyph_chars[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ :./-%";
+static const char *glyph_rows[] = {
+    "75557", "26227", "71747", "71317", "55711", "74717", "74757", "71111", "75757", "75717",
+    "25755", "65656", "34443", "65556", "74647", "74644", "34553", "55755", "72227", "11152",
+    "55655", "44447", "57755", "65555", "25552", "65644", "25563", "65655", "34216", "72222",
+    "55557", "55552", "55775", "55255", "55222", "71247", "00000", "02020", "00002", "11244",
+    "00700", "51245"
+};
+#define NUM_GLYPHS ((int)sizeof(glyph_rows) / (int)sizeof(glyph_rows[0]))
+
+static uint32_t glyph_cache[NUM_GLYPHS][GLYPH_HEIGHT * GLYPH_SCALE][GLYPH_WIDTH * GLYPH_SCALE];
+static bool is_glyph_cache_ready = false;
+
+static void build_glyph_cache(void)
+{
+    for (int g = 0; g < NUM_GLYPHS; g++)
+    {
+        for (int y = 0; y < GLYPH_HEIGHT * GLYPH_SCALE; y++)
+        {
+            int bits = glyph_rows[g][y / GLYPH_SCALE] - '0';
+            for (int x = 0; x < GLYPH_WIDTH * GLYPH_SCALE; x++)
+            {
+                bool is_set = bits & (4 >> (x / GLYPH_SCALE));
+                glyph_cache[g][y][x] = is_set ? HUD_COLOR : 0;
+            }
+        }
+    }
+    is_glyph_cache_ready = true;
+}
+
+static void draw_text(int x, int y, const char *text)
+{
+    for (int i = 0; text[i] != '\0'; i++, x += CELL_WIDTH)
+    {
+        const char *found = strchr(glyph_chars, text[i]);
+        if (found == NULL || text[i] == ' ')
+        {
+            continue;
+        }
+        int g = found - glyph_chars;
+
+        for (int row = 0; row < GLYPH_HEIGHT * GLYPH_SCALE; row++)
+        {
+            int py = y + row;
+            if (py < 0 || py >= render_height)
+            {
+                continue;
+            }
+            for (int col = 0; col < GLYPH_WIDTH * GLYPH_SCALE; col++)
+            {
+                int px = x + col;
+                if (glyph_cache[g][row][col] != 0 && px >= 0 && px < render_width)
+                {
+                    color_buffer[color_buffer_pitch * py + px] = glyph_cache[g][row][col];
+                }
+            }
+        }
+    }
+}
+
+// Counters of the last finished frame in the top left corner, over a black box
+void draw_hud(float frame_time_ms)
+{
+    if (!is_glyph_cache_ready)
+    {
+        build_glyph_cache();
+    }
+
+    const frame_stats_t *s = &last_frame_stats;
+    char lines[11][40];
+    snprintf(lines[0], sizeof(lines[0]), "FRAME MS      %.2f", frame_time_ms);
+    snprintf(lines[1], sizeof(lines[1]), "FACES         %lld", (long long)s->faces_processed);
+    snprintf(lines[2], sizeof(lines[2]), "BACKFACE      %lld", (long long)s->faces_backface_culled);
+    snprintf(lines[3], sizeof(lines[3]), "FRUSTUM       %lld", (long long)s->faces_frustum_culled);
+    snprintf(lines[4], sizeof(lines[4]), "OCCLUDED      %lld", (long long)s->faces_occlusion_culled);
+    snprintf(lines[5], sizeof(lines[5]), "CLIPPED       %lld", (long long)s->faces_clipped);
+    snprintf(lines[6], sizeof(lines[6]), "TRIANGLES     %lld", (long long)s->triangles_rasterized);
+    snprintf(lines[7], sizeof(lines[7]), "PIXELS TESTED %lld", (long long)s->pixels_tested);
+    snprintf(lines[8], sizeof(lines[8]), "PIXELS WRITTEN %lld", (long long)s->pixels_written);
+    snprintf(lines[9], sizeof(lines[9]), "TEXELS        %lld", (long long)s->texels_fetched);
+    snprintf(lines[10], sizeof(lines[10]), "UPLOAD KB     %lld", (long long)(s->bytes_uploaded / 1024));
+
+    int num_lines = sizeof(lines) / sizeof(lines[0]);
+    int width = 0;
+    for (int i = 0; i < num_lines; i++)
+    {
+        int length = strlen(lines[i]);
+        width = length > width ? length : width;
+    }
+
+    // Filled here rather than with draw_rect, the HUD's own pixels stay out of the counters
+    int margin = 4;
+    int box_width = width * CELL_WIDTH + margin * 2;
+    int box_height = num_lines * CELL_HEIGHT + margin * 2;
+    box_width = box_width < render_width ? box_width : render_width;
+    box_height = box_height < render_height ? box_height : render_height;
+    mark_dirty_rect(0, 0, box_width, box_height);
+    for (int y = 0; y < box_height; y++)
+    {
+        for (int x = 0; x < box_width; x++)
+        {
+            color_buffer[color_buffer_pitch * y + x] = HUD_BACKGROUND;
+        }
+    }
+    for (int i = 0; i < num_lines; i++)
+    {
+        draw_text(margin, margin + i * CELL_HEIGHT, lines[i]);
+    }
+}
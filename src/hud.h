@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdbool.h>
+
+extern bool is_hud_visible;
+
+void draw_hud(float frame_time_ms);
@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <SDL2/SDL.h>
+#include "jobs.h"
+#include "trace.h"
+
+int num_job_threads = -1;
+
+///////////////////////////////////////////////////////////////////////////////
+// run_jobs() hands out the indices 0..count-1 of one batch of jobs. The calling
+// thread and every worker take the next index with an atomic increment until
+// none are left, so uneven jobs balance themselves. Each batch is a new
+// generation: workers sleep on job_cond until it changes, and the caller
+// sleeps on done_cond until all of them are through with it.
+///////////////////////////////////////////////////////////////////////////////
+static SDL_Thread *job_threads[MAX_JOB_THREADS];
+static int num_started_threads = 0;
+static SDL_mutex *job_mutex = NULL;
+static SDL_cond *job_cond = NULL;
+static SDL_cond *done_cond = NULL;
+
+static job_function_t job_function = NULL;
+static void *job_data = NULL;
+static int job_count = 0;
+static SDL_atomic_t next_job;
+static int generation = 0;
+static int num_busy_threads = 0;
+static bool is_stopping = false;
+
+static void work_on_jobs(void)
+{
+    while (true)
+    {
+        int index = SDL_AtomicAdd(&next_job, 1);
+        if (index >= job_count)
+        {
+            break;
+        }
+        job_function(index, job_data);
+    }
+}
+
+static int job_thread_main(void *data)
+{
+    (void)data;
+    int seen_generation = 0;
+    trace_thread_name("job");
+
+    SDL_LockMutex(job_mutex);
+    while (true)
+    {
+        while (!is_stopping && generation == seen_generation)
+        {
+            SDL_CondWait(job_cond, job_mutex);
+        }
+        if (is_stopping)
+        {
+            break;
+        }
+        seen_generation = generation;
+        SDL_UnlockMutex(job_mutex);
+
+        work_on_jobs();
+
+        SDL_LockMutex(job_mutex);
+        num_busy_threads--;
+        if (num_busy_threads == 0)
+        {
+            SDL_CondSignal(done_cond);
+        }
+    }
+    SDL_UnlockMutex(job_mutex);
+    return 0;
+}
+
+bool start_job_threads(void)
+{
+    int count = num_job_threads >= 0 ? num_job_threads : SDL_GetCPUCount() - 1;
+    if (count > MAX_JOB_THREADS)
+    {
+        count = MAX_JOB_THREADS;
+    }
+    if (count <= 0)
+    {
+        return true;
+    }
+
+    job_mutex = SDL_CreateMutex();
+    job_cond = SDL_CreateCond();
+    done_cond = SDL_CreateCond();
+    is_stopping = false;
+    generation = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        job_threads[i] = SDL_CreateThread(job_thread_main, "job", NULL);
+        if (!job_threads[i])
+        {
+            fprintf(stderr, "Error creating job thread, running jobs on %d threads: %s \n", num_started_threads + 1, SDL_GetError());
+            break;
+        }
+        num_started_threads++;
+    }
+
+    return num_started_threads == count;
+}
+
+void stop_job_threads(void)
+{
+    if (num_started_threads > 0)
+    {
+        SDL_LockMutex(job_mutex);
+        is_stopping = true;
+        SDL_CondBroadcast(job_cond);
+        SDL_UnlockMutex(job_mutex);
+        for (int i = 0; i < num_started_threads; i++)
+        {
+            SDL_WaitThread(job_threads[i], NULL);
+        }
+        num_started_threads = 0;
+    }
+
+    SDL_DestroyCond(done_cond);
+    SDL_DestroyCond(job_cond);
+    SDL_DestroyMutex(job_mutex);
+    done_cond = NULL;
+    job_cond = NULL;
+    job_mutex = NULL;
+}
+
+// Calls function for every index from 0 to count-1 across the threads, and returns once all calls are done
+void run_jobs(job_function_t function, void *data, int count)
+{
+    if (num_started_threads == 0)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            function(i, data);
+        }
+        return;
+    }
+
+    SDL_LockMutex(job_mutex);
+    job_function = function;
+    job_data = data;
+    job_count = count;
+    SDL_AtomicSet(&next_job, 0);
+    num_busy_threads = num_started_threads;
+    generation++;
+    SDL_CondBroadcast(job_cond);
+    SDL_UnlockMutex(job_mutex);
+
+    // The calling thread takes jobs too instead of waiting idle
+    work_on_jobs();
+
+    SDL_LockMutex(job_mutex);
+    while (num_busy_threads > 0)
+    {
+        SDL_CondWait(done_cond, job_mutex);
+    }
+    SDL_UnlockMutex(job_mutex);
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdbool.h>
+
+#define MAX_JOB_THREADS 16
+
+// Worker threads besides the main thread, -1 picks one less than the number of cores
+extern int num_job_threads;
+
+typedef void (*job_function_t)(int index, void *data);
+
+bool start_job_threads(void);
+void stop_job_threads(void);
+
+void run_jobs(job_function_t function, void *data, int count);
@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "latency.h"
+#include "array.h"
+
+// Time of the earliest input that affected the frame being built, 0 when there was none
+static double frame_input_time = 0;
+
+// Input-to-present latency of every frame that had input, in milliseconds
+static float *latency_samples = NULL;
+static float last_latency_ms = 0;
+
+void record_input_time(double time)
+{
+    if (frame_input_time == 0 || time < frame_input_time)
+    {
+        frame_input_time = time;
+    }
+}
+
+// Hand the input time over to the frame being submitted and start collecting for the next one
+double take_frame_input_time(void)
+{
+    double time = frame_input_time;
+    frame_input_time = 0;
+    return time;
+}
+
+// Called on the main thread once the frame is on screen
+void record_frame_latency(double input_time, double present_time)
+{
+    if (input_time == 0)
+    {
+        return;
+    }
+    last_latency_ms = (present_time - input_time) * 1000.0;
+    array_push(latency_samples, last_latency_ms);
+}
+
+float get_last_input_latency_ms(void)
+{
+    return last_latency_ms;
+}
+
+static int compare_floats(const void *a, const void *b)
+{
+    float fa = *(const float *)a;
+    float fb = *(const float *)b;
+    return (fa > fb) - (fa < fb);
+}
+
+void print_latency_stats(void)
+{
+    int num_samples = array_length(latency_samples);
+    if (num_samples == 0)
+    {
+        return;
+    }
+
+    qsort(latency_samples, num_samples, sizeof(float), compare_floats);
+    float sum = 0;
+    for (int i = 0; i < num_samples; i++)
+    {
+        sum += latency_samples[i];
+    }
+
+    fprintf(stderr, "Input to present latency over %d frames: mean %.2f ms, p50 %.2f ms, p99 %.2f ms, max %.2f ms \n",
+        num_samples,
+        sum / num_samples,
+        latency_samples[num_samples / 2],
+        latency_samples[(num_samples * 99) / 100],
+        latency_samples[num_samples - 1]);
+}
+
+void free_latency_samples(void)
+{
+    array_free(latency_samples);
+    latency_samples = NULL;
+}
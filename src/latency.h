@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdbool.h>
+
+void record_input_time(double time);
+double take_frame_input_time(void);
+void record_frame_latency(double input_time, double present_time);
+float get_last_input_latency_ms(void);
+void print_latency_stats(void);
+void free_latency_samples(void);
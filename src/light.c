@@ -1,20 +1,138 @@
 #include <stdint.h>
+#include <math.h>
 #include "light.h"
+#include "array.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 light_t light = {
     .direction = { 0, 0, 1 }
 };
 
-uint32_t light_apply_intensity(uint32_t original_color, float percentage_factor) {
+local_light_t* local_lights = NULL;
+
+uint8_t light_lut[256][256];
+
+int add_point_light(vec3_t position, float range, float intensity) {
+    local_light_t point = {
+        .type = LIGHT_POINT,
+        .position = position,
+        .range = range,
+        .intensity = intensity
+    };
+    array_push(local_lights, point);
+    return array_length(local_lights) - 1;
+}
+
+// Angles are the half angles of the cones, in radians
+int add_spot_light(vec3_t position, vec3_t direction, float range, float intensity, float inner_angle, float outer_angle) {
+    vec3_normalize(&direction);
+    local_light_t spot = {
+        .type = LIGHT_SPOT,
+        .position = position,
+        .direction = direction,
+        .range = range,
+        .intensity = intensity,
+        .cos_inner = cos(inner_angle),
+        .cos_outer = cos(outer_angle)
+    };
+    array_push(local_lights, spot);
+    return array_length(local_lights) - 1;
+}
+
+// Light reaching a point with the given unit normal, fading to nothing at the light's range.
+// Position, normal and the light must all be in the same space.
+float local_light_contribution(const local_light_t* local_light, vec3_t position, vec3_t normal) {
+    vec3_t to_light = vec3_sub(local_light->position, position);
+    float distance = vec3_length(to_light);
+    if (distance >= local_light->range || distance == 0) {
+        return 0;
+    }
+    to_light = vec3_div(to_light, distance);
+
+    float n_dot_l = vec3_dot(normal, to_light);
+    if (n_dot_l <= 0) {
+        return 0;
+    }
+
+    float falloff = 1 - distance / local_light->range;
+    float contribution = local_light->intensity * n_dot_l * falloff * falloff;
+
+    if (local_light->type == LIGHT_SPOT) {
+        float cos_angle = -vec3_dot(to_light, local_light->direction);
+        if (cos_angle <= local_light->cos_outer) {
+            return 0;
+        }
+        if (cos_angle < local_light->cos_inner) {
+            contribution *= (cos_angle - local_light->cos_outer) / (local_light->cos_inner - local_light->cos_outer);
+        }
+    }
+    return contribution;
+}
+
+void free_local_lights(void) {
+    array_free(local_lights);
+    local_lights = NULL;
+}
+
+void init_light_lut(void) {
+    for (int level = 0; level < 256; level++) {
+        for (int channel = 0; channel < 256; channel++) {
+            light_lut[level][channel] = (channel * level + 127) / 255;
+        }
+    }
+}
+
+int light_level(float percentage_factor) {
     if (percentage_factor < 0) percentage_factor = 0;
     if (percentage_factor > 1) percentage_factor = 1;
+    return (int)(percentage_factor * 255 + 0.5);
+}
 
+uint32_t light_apply_level(uint32_t original_color, int level) {
+    const uint8_t* lut = light_lut[level];
     uint32_t a = (original_color & 0xFF000000);
-    uint32_t r = (original_color & 0x00FF0000) * percentage_factor;
-    uint32_t g = (original_color & 0x0000FF00) * percentage_factor;
-    uint32_t b = (original_color & 0x000000FF) * percentage_factor;
+    uint32_t r = lut[(original_color >> 16) & 0xFF];
+    uint32_t g = lut[(original_color >> 8) & 0xFF];
+    uint32_t b = lut[original_color & 0xFF];
+    return a | (r << 16) | (g << 8) | b;
+}
+
+uint32_t light_apply_intensity(uint32_t original_color, float percentage_factor) {
+    return light_apply_level(original_color, light_level(percentage_factor));
+}
+
+// Light count colors in place, each by its own level. Levels here are 8.8 fixed point,
+// 0 to 256 for 0 to 1, so a channel times its level fits 16 bits and a shift divides.
+void light_modulate(uint32_t* colors, const uint16_t* levels, int count) {
+    int i = 0;
+#if defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+    // Alpha keeps its value: its multiplier is always 256
+    __m128i alpha_one = _mm_set_epi16(256, 0, 0, 0, 256, 0, 0, 0);
+    __m128i color_mask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+    for (; i + 4 <= count; i += 4) {
+        __m128i pixels = _mm_loadu_si128((const __m128i*)&colors[i]);
 
-    uint32_t new_color = a | (r & 0x00FF0000) | (g & 0x0000FF00) | (b & 0x000000FF);
+        // One level per 16-bit channel of the two pixels in each half
+        __m128i l01 = _mm_set_epi16(0, levels[i + 1], levels[i + 1], levels[i + 1], 0, levels[i], levels[i], levels[i]);
+        __m128i l23 = _mm_set_epi16(0, levels[i + 3], levels[i + 3], levels[i + 3], 0, levels[i + 2], levels[i + 2], levels[i + 2]);
+        l01 = _mm_or_si128(_mm_and_si128(l01, color_mask), alpha_one);
+        l23 = _mm_or_si128(_mm_and_si128(l23, color_mask), alpha_one);
 
-    return new_color;
+        __m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(pixels, zero), l01), 8);
+        __m128i hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(pixels, zero), l23), 8);
+        _mm_storeu_si128((__m128i*)&colors[i], _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; i < count; i++) {
+        uint32_t c = colors[i];
+        uint32_t level = levels[i];
+        uint32_t r = (((c >> 16) & 0xFF) * level) >> 8;
+        uint32_t g = (((c >> 8) & 0xFF) * level) >> 8;
+        uint32_t b = ((c & 0xFF) * level) >> 8;
+        colors[i] = (c & 0xFF000000) | (r << 16) | (g << 8) | b;
+    }
 }
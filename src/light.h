@@ -9,4 +9,40 @@ typedef struct {
 
 extern light_t light;
 
+enum light_type {
+    LIGHT_POINT,
+    LIGHT_SPOT
+};
+
+// Local light in world space, it reaches nothing further than range from its position
+typedef struct {
+    enum light_type type;
+    vec3_t position;
+    vec3_t direction;   // Spot lights only, where the cone points
+    float range;
+    float intensity;
+    float cos_inner;    // Spot lights only, full intensity inside this angle, none outside cos_outer
+    float cos_outer;
+} local_light_t;
+
+extern local_light_t* local_lights;
+
+int add_point_light(vec3_t position, float range, float intensity);
+int add_spot_light(vec3_t position, vec3_t direction, float range, float intensity, float inner_angle, float outer_angle);
+float local_light_contribution(const local_light_t* light, vec3_t position, vec3_t normal);
+void free_local_lights(void);
+
+///////////////////////////////////////////////////////////////////////////////
+// Light intensities are quantized to 256 levels. For every level the table
+// holds the lit value of each 8-bit channel, so lighting a color with a known
+// level is three lookups:
+//
+//   lit = light_lut[level][channel] = channel * level / 255
+///////////////////////////////////////////////////////////////////////////////
+extern uint8_t light_lut[256][256];
+
+void init_light_lut(void);
+int light_level(float percentage_factor);
+uint32_t light_apply_level(uint32_t original_color, int level);
 uint32_t light_apply_intensity(uint32_t original_color, float percentage_factor);
+void light_modulate(uint32_t* colors, const uint16_t* levels, int count);
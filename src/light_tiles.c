@@ -0,0 +1,232 @@
+#include <stdlib.h>
+#include <float.h>
+#include <math.h>
+#include "light_tiles.h"
+#include "light.h"
+#include "display.h"
+#include "array.h"
+
+// Same distance as the projection's near plane
+#define LIGHT_TILE_NEAR 0.1
+
+typedef struct {
+    float min_z;    // View space depth range of the triangles over the tile, min > max when empty
+    float max_z;
+    int first;      // Range of the tile's lights in tile_lights
+    int count;
+} light_tile_t;
+
+static light_tile_t* tiles = NULL;
+static int tiles_capacity = 0;
+static int tiles_x = 0;
+static int tiles_y = 0;
+static int* tile_lights = NULL;
+static int tile_lights_capacity = 0;
+
+// Local lights moved to view space for this frame
+static local_light_t* view_lights = NULL;
+static int view_lights_capacity = 0;
+
+// Inclusive range of tiles covered by a screen rectangle, false when it misses the screen
+static bool tile_range(float min_x, float min_y, float max_x, float max_y, int* x0, int* y0, int* x1, int* y1) {
+    if (max_x < 0 || max_y < 0 || min_x >= render_width || min_y >= render_height) {
+        return false;
+    }
+    *x0 = min_x < 0 ? 0 : (int)min_x / LIGHT_TILE_SIZE;
+    *y0 = min_y < 0 ? 0 : (int)min_y / LIGHT_TILE_SIZE;
+    *x1 = max_x >= render_width ? tiles_x - 1 : (int)max_x / LIGHT_TILE_SIZE;
+    *y1 = max_y >= render_height ? tiles_y - 1 : (int)max_y / LIGHT_TILE_SIZE;
+    return true;
+}
+
+static void compute_tile_depth_ranges(const triangle_t* triangles, int num_triangles) {
+    for (int i = 0; i < tiles_x * tiles_y; i++) {
+        tiles[i].min_z = FLT_MAX;
+        tiles[i].max_z = -FLT_MAX;
+        tiles[i].count = 0;
+    }
+
+    for (int i = 0; i < num_triangles; i++) {
+        const vec4_t* v = triangles[i].vertices;
+        float min_x = fminf(v[0].x, fminf(v[1].x, v[2].x));
+        float min_y = fminf(v[0].y, fminf(v[1].y, v[2].y));
+        float max_x = fmaxf(v[0].x, fmaxf(v[1].x, v[2].x));
+        float max_y = fmaxf(v[0].y, fmaxf(v[1].y, v[2].y));
+        // w keeps the view space depth of every vertex
+        float min_z = fminf(v[0].w, fminf(v[1].w, v[2].w));
+        float max_z = fmaxf(v[0].w, fmaxf(v[1].w, v[2].w));
+
+        int x0, y0, x1, y1;
+        if (!tile_range(min_x, min_y, max_x, max_y, &x0, &y0, &x1, &y1)) {
+            continue;
+        }
+        for (int ty = y0; ty <= y1; ty++) {
+            for (int tx = x0; tx <= x1; tx++) {
+                light_tile_t* tile = &tiles[ty * tiles_x + tx];
+                tile->min_z = min_z < tile->min_z ? min_z : tile->min_z;
+                tile->max_z = max_z > tile->max_z ? max_z : tile->max_z;
+            }
+        }
+    }
+}
+
+// Screen rectangle around a view space sphere: the extremes of its bounding box over its nearest and farthest depth
+static bool light_tile_range(const local_light_t* view_light, mat4_t projection_matrix, int* x0, int* y0, int* x1, int* y1) {
+    vec3_t c = view_light->position;
+    float r = view_light->range;
+    if (c.z + r < LIGHT_TILE_NEAR) {
+        return false;
+    }
+    if (c.z - r < LIGHT_TILE_NEAR) {
+        *x0 = 0;
+        *y0 = 0;
+        *x1 = tiles_x - 1;
+        *y1 = tiles_y - 1;
+        return true;
+    }
+
+    float near_z = c.z - r;
+    float far_z = c.z + r;
+    float left = fminf((c.x - r) / near_z, (c.x - r) / far_z) * projection_matrix.m[0][0];
+    float right = fmaxf((c.x + r) / near_z, (c.x + r) / far_z) * projection_matrix.m[0][0];
+    float bottom = fminf((c.y - r) / near_z, (c.y - r) / far_z) * projection_matrix.m[1][1];
+    float top = fmaxf((c.y + r) / near_z, (c.y + r) / far_z) * projection_matrix.m[1][1];
+
+    // Same viewport mapping as the geometry stage, y grows downwards on screen
+    float half_width = render_width / 2;
+    float half_height = render_height / 2;
+    return tile_range(
+        left * half_width + half_width, -top * half_height + half_height,
+        right * half_width + half_width, -bottom * half_height + half_height,
+        x0, y0, x1, y1
+    );
+}
+
+// Count the lights of every tile, turn the counts into ranges, then fill them with the same tests
+static void build_tile_light_lists(int num_lights, mat4_t projection_matrix) {
+    for (int pass = 0; pass < 2; pass++) {
+        if (pass == 1) {
+            int total = 0;
+            for (int i = 0; i < tiles_x * tiles_y; i++) {
+                tiles[i].first = total;
+                total += tiles[i].count;
+                tiles[i].count = 0;
+            }
+            if (total > tile_lights_capacity) {
+                tile_lights_capacity = total * 2;
+                tile_lights = (int*)realloc(tile_lights, sizeof(int) * tile_lights_capacity);
+            }
+        }
+
+        for (int l = 0; l < num_lights; l++) {
+            const local_light_t* view_light = &view_lights[l];
+            int x0, y0, x1, y1;
+            if (!light_tile_range(view_light, projection_matrix, &x0, &y0, &x1, &y1)) {
+                continue;
+            }
+            float light_min_z = view_light->position.z - view_light->range;
+            float light_max_z = view_light->position.z + view_light->range;
+            for (int ty = y0; ty <= y1; ty++) {
+                for (int tx = x0; tx <= x1; tx++) {
+                    light_tile_t* tile = &tiles[ty * tiles_x + tx];
+                    if (tile->min_z > light_max_z || tile->max_z < light_min_z) {
+                        continue;
+                    }
+                    if (pass == 1) {
+                        tile_lights[tile->first + tile->count] = l;
+                    }
+                    tile->count++;
+                }
+            }
+        }
+    }
+}
+
+// Sum of the lights in the tile under a screen point, at the view space position behind it
+static float tile_lighting(mat4_t projection_matrix, float screen_x, float screen_y, float view_z, vec3_t normal) {
+    int tx = screen_x < 0 ? 0 : (int)screen_x / LIGHT_TILE_SIZE;
+    int ty = screen_y < 0 ? 0 : (int)screen_y / LIGHT_TILE_SIZE;
+    tx = tx >= tiles_x ? tiles_x - 1 : tx;
+    ty = ty >= tiles_y ? tiles_y - 1 : ty;
+    light_tile_t* tile = &tiles[ty * tiles_x + tx];
+    if (tile->count == 0) {
+        return 0;
+    }
+
+    // Undo the viewport mapping and the perspective divide
+    float half_width = render_width / 2;
+    float half_height = render_height / 2;
+    vec3_t position = {
+        (screen_x - half_width) / half_width * view_z / projection_matrix.m[0][0],
+        -(screen_y - half_height) / half_height * view_z / projection_matrix.m[1][1],
+        view_z
+    };
+
+    float sum = 0;
+    for (int i = 0; i < tile->count; i++) {
+        sum += local_light_contribution(&view_lights[tile_lights[tile->first + i]], position, normal);
+    }
+    return sum;
+}
+
+// Add the local lights to the intensities from the directional light, and bake the color of flat shaded triangles
+void shade_triangles(triangle_t* triangles, int num_triangles, mat4_t view_matrix, mat4_t projection_matrix, bool is_flat) {
+    int num_lights = array_length(local_lights);
+
+    if (num_lights > 0) {
+        tiles_x = (render_width + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+        tiles_y = (render_height + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+        if (tiles_x * tiles_y > tiles_capacity) {
+            tiles_capacity = tiles_x * tiles_y;
+            tiles = (light_tile_t*)realloc(tiles, sizeof(light_tile_t) * tiles_capacity);
+        }
+        if (num_lights > view_lights_capacity) {
+            view_lights_capacity = num_lights;
+            view_lights = (local_light_t*)realloc(view_lights, sizeof(local_light_t) * num_lights);
+        }
+
+        for (int l = 0; l < num_lights; l++) {
+            view_lights[l] = local_lights[l];
+            view_lights[l].position = vec3_from_vec4(mat4_mul_vec4(view_matrix, vec4_from_vec3(local_lights[l].position)));
+            vec4_t direction = { local_lights[l].direction.x, local_lights[l].direction.y, local_lights[l].direction.z, 0 };
+            view_lights[l].direction = vec3_from_vec4(mat4_mul_vec4(view_matrix, direction));
+        }
+
+        compute_tile_depth_ranges(triangles, num_triangles);
+        build_tile_light_lists(num_lights, projection_matrix);
+    }
+
+    for (int i = 0; i < num_triangles; i++) {
+        triangle_t* triangle = &triangles[i];
+        if (num_lights > 0 && is_flat) {
+            vec4_t* v = triangle->vertices;
+            float added = tile_lighting(projection_matrix,
+                (v[0].x + v[1].x + v[2].x) / 3, (v[0].y + v[1].y + v[2].y) / 3, (v[0].w + v[1].w + v[2].w) / 3,
+                triangle->normals[0]);
+            for (int j = 0; j < 3; j++) {
+                triangle->intensities[j] += added;
+            }
+        } else if (num_lights > 0) {
+            for (int j = 0; j < 3; j++) {
+                vec4_t v = triangle->vertices[j];
+                triangle->intensities[j] += tile_lighting(projection_matrix, v.x, v.y, v.w, triangle->normals[j]);
+            }
+        }
+
+        if (is_flat) {
+            triangle->color = light_apply_intensity(triangle->color, triangle->intensities[0]);
+        }
+    }
+}
+
+void free_light_tiles(void) {
+    free(tiles);
+    free(tile_lights);
+    free(view_lights);
+    tiles = NULL;
+    tile_lights = NULL;
+    view_lights = NULL;
+    tiles_capacity = 0;
+    tile_lights_capacity = 0;
+    view_lights_capacity = 0;
+}
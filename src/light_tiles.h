@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdbool.h>
+#include "matrix.h"
+#include "triangle.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Tiled local lights
+///////////////////////////////////////////////////////////////////////////////
+// Runs on the projected triangles, after the geometry stage and before they
+// are sorted and drawn:
+//
+//   1. every screen tile gets the depth range of the triangles over it
+//   2. every light's bounding sphere is tested against the tiles under its
+//      screen rectangle, and added to the list of those it reaches in depth
+//   3. every vertex (flat shading: every triangle center) adds up the lights
+//      in the list of its tile
+//
+// Tiles without geometry get no lights, and a vertex never looks at lights
+// outside its own tile, so the cost follows how many lights overlap locally.
+///////////////////////////////////////////////////////////////////////////////
+#define LIGHT_TILE_SIZE 16
+
+void shade_triangles(triangle_t* triangles, int num_triangles, mat4_t view_matrix, mat4_t projection_matrix, bool is_flat);
+void free_light_tiles(void);
@@ -0,0 +1,369 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "lod.h"
+#include "array.h"
+
+float lod_switch_radius = 64.0;
+float lod_hysteresis = 0.15;
+
+// Symmetric 4x4 error quadric of the planes around a vertex, upper triangle only:
+//   | q0 q1 q2 q3 |
+//   |    q4 q5 q6 |
+//   |       q7 q8 |
+//   |          q9 |
+typedef struct {
+    double q[10];
+} quadric_t;
+
+static void quadric_add_plane(quadric_t* quadric, double a, double b, double c, double d, double weight) {
+    double* q = quadric->q;
+    q[0] += weight * a * a; q[1] += weight * a * b; q[2] += weight * a * c; q[3] += weight * a * d;
+    q[4] += weight * b * b; q[5] += weight * b * c; q[6] += weight * b * d;
+    q[7] += weight * c * c; q[8] += weight * c * d;
+    q[9] += weight * d * d;
+}
+
+// Sum of squared distances from p to the planes in both quadrics
+static double quadric_error(const quadric_t* a, const quadric_t* b, vec3_t p) {
+    double q[10];
+    for (int i = 0; i < 10; i++) {
+        q[i] = a->q[i] + b->q[i];
+    }
+    double x = p.x, y = p.y, z = p.z;
+    return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x
+         + q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y
+         + q[7] * z * z + 2 * q[8] * z
+         + q[9];
+}
+
+static int* face_index(face_t* face, int corner) {
+    return corner == 0 ? &face->a : corner == 1 ? &face->b : &face->c;
+}
+
+static tex2_t* face_uv(face_t* face, int corner) {
+    return corner == 0 ? &face->a_uv : corner == 1 ? &face->b_uv : &face->c_uv;
+}
+
+static int* face_vn(face_t* face, int corner) {
+    return corner == 0 ? &face->a_vn : corner == 1 ? &face->b_vn : &face->c_vn;
+}
+
+static int face_corner(const face_t* face, int vertex) {
+    if (face->a == vertex) return 0;
+    if (face->b == vertex) return 1;
+    if (face->c == vertex) return 2;
+    return -1;
+}
+
+// What a face stores per corner besides the position, faces only agree on a vertex when all of it matches
+typedef struct {
+    tex2_t uv;
+    int vn;
+} corner_t;
+
+static corner_t face_corner_attributes(face_t* face, int corner) {
+    corner_t result = { *face_uv(face, corner), *face_vn(face, corner) };
+    return result;
+}
+
+static bool corner_equal(corner_t a, corner_t b) {
+    return fabs(a.uv.u - b.uv.u) < 1e-5 && fabs(a.uv.v - b.uv.v) < 1e-5 && a.vn == b.vn;
+}
+
+static vec3_t face_normal(const vec3_t* vertices, int a, int b, int c) {
+    vec3_t ab = vec3_sub(vertices[b], vertices[a]);
+    vec3_t ac = vec3_sub(vertices[c], vertices[a]);
+    return vec3_cross(ab, ac);
+}
+
+typedef struct {
+    int from;
+    int to;
+    double cost;
+} collapse_t;
+
+static int compare_collapse_cost(const void* a, const void* b) {
+    double ca = ((const collapse_t*)a)->cost;
+    double cb = ((const collapse_t*)b)->cost;
+    return (ca > cb) - (ca < cb);
+}
+
+// Working state of the simplification, shared by all the levels of one mesh
+typedef struct {
+    const vec3_t* vertices;
+    int num_vertices;
+    face_t* faces;
+    bool* is_face_alive;
+    int num_alive_faces;
+    int** vertex_faces;  // Faces around each vertex, may still list dead ones
+    quadric_t* quadrics;
+    bool* is_locked;     // UV or normal seam and open boundary vertices never move
+} simplifier_t;
+
+// A vertex is locked when its faces don't agree on its UV or normal, or when it sits on an edge used by only
+// one face. Moving either kind would tear the texture, soften a hard edge or shrink the outline of the mesh.
+static void lock_seams_and_borders(simplifier_t* s) {
+    for (int v = 0; v < s->num_vertices; v++) {
+        int* around = s->vertex_faces[v];
+        int n = array_length(around);
+        for (int i = 0; i < n && !s->is_locked[v]; i++) {
+            face_t* face = &s->faces[around[i]];
+            corner_t attributes = face_corner_attributes(face, face_corner(face, v));
+            if (!corner_equal(attributes, face_corner_attributes(&s->faces[around[0]], face_corner(&s->faces[around[0]], v)))) {
+                s->is_locked[v] = true;
+            }
+
+            // Count how many faces around v share each of this face's other two vertices
+            for (int corner = 0; corner < 3; corner++) {
+                int w = *face_index(face, corner);
+                if (w == v) {
+                    continue;
+                }
+                int shared = 0;
+                for (int j = 0; j < n; j++) {
+                    shared += face_corner(&s->faces[around[j]], w) >= 0;
+                }
+                if (shared == 1) {
+                    s->is_locked[v] = true;
+                }
+            }
+        }
+    }
+}
+
+// Checks that moving vertex from onto vertex to keeps the texture and normals and doesn't fold any face over.
+// On success new_corner holds the UV and normal of to on the faces that collapse.
+static bool can_collapse(simplifier_t* s, int from, int to, corner_t* new_corner) {
+    if (s->is_locked[from]) {
+        return false;
+    }
+
+    int* around = s->vertex_faces[from];
+    int num_shared = 0;
+    for (int i = 0; i < array_length(around); i++) {
+        face_t* face = &s->faces[around[i]];
+        if (!s->is_face_alive[around[i]]) {
+            continue;
+        }
+        int corner = face_corner(face, to);
+        if (corner < 0) {
+            continue;
+        }
+        corner_t attributes = face_corner_attributes(face, corner);
+        if (num_shared > 0 && !corner_equal(attributes, *new_corner)) {
+            return false; // The edge is a seam on the side of the target vertex
+        }
+        *new_corner = attributes;
+        num_shared++;
+    }
+    if (num_shared == 0 || num_shared > 2) {
+        return false; // Not an edge any more, or a non-manifold one
+    }
+
+    for (int i = 0; i < array_length(around); i++) {
+        face_t* face = &s->faces[around[i]];
+        if (!s->is_face_alive[around[i]] || face_corner(face, to) >= 0) {
+            continue;
+        }
+        int corners[3] = { face->a, face->b, face->c };
+        vec3_t before = face_normal(s->vertices, corners[0], corners[1], corners[2]);
+        corners[face_corner(face, from)] = to;
+        vec3_t after = face_normal(s->vertices, corners[0], corners[1], corners[2]);
+
+        float length_before = vec3_length(before);
+        float length_after = vec3_length(after);
+        if (length_after < 1e-12 || vec3_dot(before, after) < 0.5 * length_before * length_after) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void collapse(simplifier_t* s, int from, int to, corner_t new_corner) {
+    int* around = s->vertex_faces[from];
+    for (int i = 0; i < array_length(around); i++) {
+        int f = around[i];
+        face_t* face = &s->faces[f];
+        if (!s->is_face_alive[f]) {
+            continue;
+        }
+        if (face_corner(face, to) >= 0) {
+            s->is_face_alive[f] = false;
+            s->num_alive_faces--;
+            continue;
+        }
+        int corner = face_corner(face, from);
+        *face_index(face, corner) = to;
+        *face_uv(face, corner) = new_corner.uv;
+        *face_vn(face, corner) = new_corner.vn;
+        array_push(s->vertex_faces[to], f);
+    }
+
+    for (int i = 0; i < 10; i++) {
+        s->quadrics[to].q[i] += s->quadrics[from].q[i];
+    }
+    array_free(s->vertex_faces[from]);
+    s->vertex_faces[from] = NULL;
+}
+
+// Collapse the cheapest edges until at most target_faces are left, or nothing can collapse.
+// Each pass sorts all the candidate edges by error and applies the cheapest ones that don't
+// touch a vertex moved earlier in the same pass, so the costs it uses are never stale.
+static void simplify(simplifier_t* s, int target_faces) {
+    collapse_t* candidates = NULL;
+    bool* is_touched = (bool*)malloc(sizeof(bool) * s->num_vertices);
+    int num_faces = array_length(s->faces);
+
+    while (s->num_alive_faces > target_faces) {
+        array_free(candidates);
+        candidates = NULL;
+        for (int f = 0; f < num_faces; f++) {
+            if (!s->is_face_alive[f]) {
+                continue;
+            }
+            for (int corner = 0; corner < 3; corner++) {
+                int u = *face_index(&s->faces[f], corner);
+                int v = *face_index(&s->faces[f], (corner + 1) % 3);
+                double cost = quadric_error(&s->quadrics[u], &s->quadrics[v], s->vertices[v]);
+                collapse_t forward = { u, v, cost };
+                array_push(candidates, forward);
+                cost = quadric_error(&s->quadrics[u], &s->quadrics[v], s->vertices[u]);
+                collapse_t backward = { v, u, cost };
+                array_push(candidates, backward);
+            }
+        }
+        qsort(candidates, array_length(candidates), sizeof(collapse_t), compare_collapse_cost);
+
+        // Close half of the remaining gap per pass, every collapse removes about two faces
+        int budget = (s->num_alive_faces - target_faces) / 4 + 1;
+        int num_collapsed = 0;
+        memset(is_touched, 0, sizeof(bool) * s->num_vertices);
+
+        for (int i = 0; i < array_length(candidates) && num_collapsed < budget; i++) {
+            int from = candidates[i].from;
+            int to = candidates[i].to;
+            corner_t new_corner = { { 0, 0 }, 0 };
+            if (is_touched[from] || is_touched[to] || !can_collapse(s, from, to, &new_corner)) {
+                continue;
+            }
+
+            // Neighbour costs change with this collapse, leave them for the next pass
+            int* around = s->vertex_faces[from];
+            for (int j = 0; j < array_length(around); j++) {
+                face_t* face = &s->faces[around[j]];
+                is_touched[face->a] = is_touched[face->b] = is_touched[face->c] = true;
+            }
+            collapse(s, from, to, new_corner);
+            num_collapsed++;
+        }
+
+        if (num_collapsed == 0) {
+            break;
+        }
+    }
+
+    array_free(candidates);
+    free(is_touched);
+}
+
+// Generate levels 1 .. num_lods - 1, each with about half the faces of the one before.
+// Stops early when the seams leave too little to collapse for a level to be worth it.
+void build_mesh_lods(mesh_t* mesh, int num_lods) {
+    if (num_lods > MAX_MESH_LODS) {
+        num_lods = MAX_MESH_LODS;
+    }
+
+    int num_vertices = array_length(mesh->vertices);
+    int num_faces = array_length(mesh->faces);
+
+    simplifier_t s = {
+        .vertices = mesh->vertices,
+        .num_vertices = num_vertices,
+        .faces = NULL,
+        .is_face_alive = (bool*)malloc(sizeof(bool) * num_faces),
+        .num_alive_faces = num_faces,
+        .vertex_faces = (int**)calloc(num_vertices, sizeof(int*)),
+        .quadrics = (quadric_t*)calloc(num_vertices, sizeof(quadric_t)),
+        .is_locked = (bool*)calloc(num_vertices, sizeof(bool))
+    };
+
+    for (int f = 0; f < num_faces; f++) {
+        face_t face = mesh->faces[f];
+        array_push(s.faces, face);
+        s.is_face_alive[f] = true;
+
+        // Plane of the face, weighted by its area so slivers don't dominate the error
+        vec3_t normal = face_normal(mesh->vertices, face.a, face.b, face.c);
+        float length = vec3_length(normal);
+        if (length > 0) {
+            double a = normal.x / length, b = normal.y / length, c = normal.z / length;
+            double d = -(a * mesh->vertices[face.a].x + b * mesh->vertices[face.a].y + c * mesh->vertices[face.a].z);
+            for (int corner = 0; corner < 3; corner++) {
+                quadric_add_plane(&s.quadrics[*face_index(&face, corner)], a, b, c, d, length * 0.5);
+            }
+        }
+        for (int corner = 0; corner < 3; corner++) {
+            array_push(s.vertex_faces[*face_index(&face, corner)], f);
+        }
+    }
+    lock_seams_and_borders(&s);
+
+    mesh->num_lods = 1;
+    int previous_faces = num_faces;
+    for (int level = 1; level < num_lods; level++) {
+        simplify(&s, previous_faces / 2);
+        if (s.num_alive_faces > previous_faces * 0.9) {
+            break;
+        }
+
+        face_t* lod = NULL;
+        for (int f = 0; f < num_faces; f++) {
+            if (s.is_face_alive[f]) {
+                array_push(lod, s.faces[f]);
+            }
+        }
+        compute_face_planes(lod, mesh->vertices);
+        mesh->lods[level - 1] = lod;
+        mesh->num_lods = level + 1;
+        previous_faces = s.num_alive_faces;
+    }
+
+    for (int v = 0; v < num_vertices; v++) {
+        array_free(s.vertex_faces[v]);
+    }
+    free(s.vertex_faces);
+    free(s.quadrics);
+    free(s.is_locked);
+    free(s.is_face_alive);
+    array_free(s.faces);
+}
+
+face_t* mesh_lod_faces(const mesh_t* mesh, int level) {
+    return level == 0 ? mesh->faces : mesh->lods[level - 1];
+}
+
+// The level only changes once the radius is clearly past a switch point, in either direction
+int select_mesh_lod(const mesh_t* mesh, int current_level, float pixel_radius) {
+    if (mesh->num_lods <= 1) {
+        return 0;
+    }
+    if (current_level >= mesh->num_lods) {
+        current_level = mesh->num_lods - 1;
+    }
+
+    // Switch point between level - 1 and level
+    #define SWITCH_RADIUS(level) (lod_switch_radius / (float)(1 << ((level) - 1)))
+
+    while (current_level + 1 < mesh->num_lods &&
+           pixel_radius < SWITCH_RADIUS(current_level + 1) * (1 - lod_hysteresis)) {
+        current_level++;
+    }
+    while (current_level > 0 &&
+           pixel_radius > SWITCH_RADIUS(current_level) * (1 + lod_hysteresis)) {
+        current_level--;
+    }
+
+    #undef SWITCH_RADIUS
+    return current_level;
+}
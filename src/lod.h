@@ -0,0 +1,26 @@
+#pragma once
+
+#include "mesh.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Level of detail
+///////////////////////////////////////////////////////////////////////////////
+// Every level halves the face count of the previous one with quadric error
+// edge collapses. A collapse moves one vertex onto a neighbour, so the levels
+// only need new face lists over the original vertices.
+//
+// The level is picked from the bounding sphere radius on screen, in pixels:
+//
+//   radius >= lod_switch_radius          -> level 0
+//   radius >= lod_switch_radius / 2      -> level 1
+//   radius >= lod_switch_radius / 4      -> level 2 ...
+//
+// and each switch point is widened by lod_hysteresis in both directions, so an
+// object sitting right on one doesn't flip between two levels every frame.
+///////////////////////////////////////////////////////////////////////////////
+extern float lod_switch_radius;
+extern float lod_hysteresis;
+
+void build_mesh_lods(mesh_t* mesh, int num_lods);
+face_t* mesh_lod_faces(const mesh_t* mesh, int level);
+int select_mesh_lod(const mesh_t* mesh, int current_level, float pixel_radius);
@@ -1,11 +1,14 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
+#include <math.h>
 #include <SDL2/SDL.h>
 #include "display.h"
 #include "upng.h"
 #include "vector.h"
 #include "mesh.h"
+#include "scene.h"
 #include "array.h"
 #include "matrix.h"
 #include "light.h"
@@ -13,48 +16,174 @@
 #include "triangle.h"
 #include "camera.h"
 #include "clipping.h"
+#include "present.h"
+#include "resolution.h"
+#include "capture.h"
+#include "pacing.h"
+#include "latency.h"
+#include "geometry.h"
+#include "lod.h"
+#include "occlusion.h"
+#include "light_tiles.h"
+#include "shadow.h"
+#include "deferred.h"
+#include "jobs.h"
+#include "pipeline.h"
+#include "bench.h"
+#include "stats.h"
+#include "hud.h"
+#include "trace.h"
+#include "heatmap.h"
 
 #ifndef M_PI
 #    define M_PI 3.14159265358979323846
 #endif
 
-enum cull_method {
-    CULL_NONE,
-    CULL_BACKFACE
-} cull_method;
+enum render_method render_method = RENDER_WIRE;
 
-enum render_method {
-    RENDER_WIRE,
-    RENDER_WIRE_VERTEX,
-    RENDER_FILL_TRIANGLE,
-    RENDER_FILL_TRIANGLE_WIRE,
-    RENDER_TEXTURED,
-    RENDER_TEXTURED_WIRE
-} render_method;
+bool is_running = false;
+int frame_limit = 0;
+int headless_width = 1280;
+int headless_height = 720;
+const char *capture_path = NULL;
+const char *bench_path = NULL;
+const char *stats_csv_path = NULL;
+const char *trace_path = NULL;
+#define MAX_MODELS 16
+char *model_names[MAX_MODELS];
+int num_models = 0;
+int num_instances = 1;
+bool is_instanced = false;
+bool is_mesh_clustered = true;
+int num_mesh_lods = 1;
+// Median splits leave between half of this and this many faces per cluster
+#define MESH_CLUSTER_SIZE 128
+int *visible_leaves = NULL;
+int num_point_lights = 0;
+int num_spot_lights = 0;
+enum capture_format capture_format = CAPTURE_NONE;
+double frame_start_time = 0;
+float delta_time = 0;
+float last_frame_time_ms = 0;
 
-triangle_t *triangles_to_render = NULL;
+// Load every model given on the command line from ./assets/<name>.obj and .png, and lay
+// out num_instances copies of them on a grid in front of the camera
+void load_scene(void)
+{
+    if (num_models == 0)
+    {
+        model_names[num_models++] = "f22";
+    }
 
-mat4_t world_matrix;
-mat4_t projection_matrix;
-mat4_t view_matrix;
+    int meshes[MAX_MODELS];
+    int textures[MAX_MODELS];
+    for (int i = 0; i < num_models; i++)
+    {
+        char filename[256];
+        snprintf(filename, sizeof(filename), "./assets/%s.obj", model_names[i]);
+        meshes[i] = scene_load_mesh(filename);
+        if (is_mesh_clustered && meshes[i] >= 0)
+        {
+            build_mesh_clusters(&scene.meshes[meshes[i]], MESH_CLUSTER_SIZE);
+        }
+        if (num_mesh_lods > 1 && meshes[i] >= 0)
+        {
+            build_mesh_lods(&scene.meshes[meshes[i]], num_mesh_lods);
+        }
+        snprintf(filename, sizeof(filename), "./assets/%s.png", model_names[i]);
+        textures[i] = scene_load_texture(filename);
+    }
 
-bool is_running = false;
-uint32_t previous_frame_ms = 0;
-float delta_time = 0;
+    int batches[MAX_MODELS];
+    for (int i = 0; i < num_models; i++)
+    {
+        batches[i] = (is_instanced && meshes[i] >= 0) ? scene_add_instance_batch(meshes[i], textures[i]) : -1;
+    }
+
+    int columns = (int)ceil(sqrt(num_instances));
+    int rows = (num_instances + columns - 1) / columns;
+    float spacing = 3.0;
+    for (int i = 0; i < num_instances; i++)
+    {
+        int model = i % num_models;
+        if (meshes[model] < 0)
+        {
+            continue;
+        }
+
+        vec3_t scale = { 1.0, 1.0, 1.0 };
+        vec3_t rotation = { 0, 0, 0 };
+        vec3_t translation = {
+            ((i % columns) - (columns - 1) / 2.0) * spacing,
+            ((i / columns) - (rows - 1) / 2.0) * spacing,
+            5.0 + (columns - 1) * spacing
+        };
+        if (batches[model] >= 0)
+        {
+            instance_t placement = { .rotation = rotation, .scale = scale, .translation = translation };
+            scene_batch_add_instance(batches[model], scene_instance_world_matrix(&placement));
+        }
+        else
+        {
+            scene_add_instance(meshes[model], textures[model], scale, rotation, translation);
+        }
+    }
+
+    scene_build_bvh();
+}
+
+// Scatter the local lights from the command line over the scene, the same way every run
+void place_lights(void)
+{
+    if (scene.bvh.num_nodes == 0)
+    {
+        return;
+    }
+
+    aabb_t bounds = scene.bvh.nodes[0].bounds;
+    vec3_t size = vec3_sub(bounds.max, bounds.min);
+    srand(1);
+    for (int i = 0; i < num_point_lights; i++)
+    {
+        vec3_t position = {
+            bounds.min.x + size.x * rand() / (float)RAND_MAX,
+            bounds.min.y + size.y * rand() / (float)RAND_MAX,
+            bounds.min.z - 1.0
+        };
+        add_point_light(position, 4.0, 0.8);
+    }
+
+    // Spots stand in front of the grid and shine into it
+    for (int i = 0; i < num_spot_lights; i++)
+    {
+        vec3_t position = {
+            bounds.min.x + size.x * rand() / (float)RAND_MAX,
+            bounds.min.y + size.y * rand() / (float)RAND_MAX,
+            bounds.min.z - 3.0
+        };
+        vec3_t direction = { 0, 0, 1 };
+        add_spot_light(position, direction, 12.0, 1.0, 15.0 * M_PI / 180.0, 25.0 * M_PI / 180.0);
+    }
+}
 
 void setup()
 {
-    render_method = RENDER_WIRE;
-    cull_method = CULL_BACKFACE;
+    back_buffer = (uint32_t *)malloc(sizeof(uint32_t) * window_width * window_height);
+    color_buffer = back_buffer;
+    color_buffer_pitch = window_width;
 
-    color_buffer = (uint32_t *)malloc(sizeof(uint32_t) * window_width * window_height);
+    init_background(0xFF000000);
+    init_light_lut();
 
-    color_buffer_texture = SDL_CreateTexture(
-        renderer,
-        SDL_PIXELFORMAT_RGBA32,
-        SDL_TEXTUREACCESS_STREAMING,
-        window_width,
-        window_height);
+    if (!is_headless)
+    {
+        color_buffer_texture = SDL_CreateTexture(
+            renderer,
+            SDL_PIXELFORMAT_RGBA32,
+            SDL_TEXTUREACCESS_STREAMING,
+            window_width,
+            window_height);
+    }
 
     float fov = M_PI/1.8;
     float aspect = (float)window_height / (float)window_width;
@@ -69,81 +198,166 @@ void setup()
     );
 
     // Initialise furstum planes with a point and a normal
-    init_frustum_planes(fov, znear, zfar);
+    // The horizontal field of view is wider than the vertical one on landscape screens
+    float fov_x = 2 * atan(tan(fov / 2) * ((float)window_width / (float)window_height));
+    init_frustum_planes(fov_x, fov, znear, zfar);
 
-    // load_cube_mesh_data();
-    load_obj_file_data("./assets/f22.obj");
+    load_scene();
+    place_lights();
+
+    if (is_deferred_shading)
+    {
+        start_job_threads();
+    }
+}
 
-    load_png_texture_data("./assets/f22.png");
+// Time of an event on our clock, from its SDL timestamp and the time both clocks were read.
+// Events pumped while the queue drains are stamped after now_ms, they count as happening now.
+double event_time(double now, uint32_t now_ms, uint32_t timestamp)
+{
+    int64_t age_ms = (int64_t)now_ms - (int64_t)timestamp;
+    if (age_ms < 0)
+    {
+        age_ms = 0;
+    }
+    return now - age_ms / 1000.0;
 }
 
 void process_input(void)
 {
+    if (is_headless)
+    {
+        return;
+    }
+
+    // SDL timestamps events in milliseconds since init, convert them to our clock
+    double now = get_time_seconds();
+    uint32_t now_ms = SDL_GetTicks();
+
+    // Drain everything that queued up since the last frame, not just one event
     SDL_Event event;
-    SDL_PollEvent(&event);
-    switch (event.type) {
-        case SDL_QUIT:
-            is_running = false;
-            break;
-        case SDL_KEYDOWN:
-            if (event.key.keysym.sym == SDLK_ESCAPE)
+    while (SDL_PollEvent(&event)) {
+        switch (event.type) {
+            case SDL_QUIT:
                 is_running = false;
-            if (event.key.keysym.sym == SDLK_1)
-                render_method = RENDER_WIRE_VERTEX;
-            if (event.key.keysym.sym == SDLK_2)
-                render_method = RENDER_WIRE;
-            if (event.key.keysym.sym == SDLK_3)
-                render_method = RENDER_FILL_TRIANGLE;
-            if (event.key.keysym.sym == SDLK_4)
-                render_method = RENDER_FILL_TRIANGLE_WIRE;
-            if (event.key.keysym.sym == SDLK_5)
-                render_method = RENDER_TEXTURED;
-            if (event.key.keysym.sym == SDLK_6)
-                render_method = RENDER_TEXTURED_WIRE;
-            if (event.key.keysym.sym == SDLK_c)
-                cull_method = CULL_BACKFACE;
-            if (event.key.keysym.sym == SDLK_d)
-                cull_method = CULL_NONE;
-            if (event.key.keysym.sym == SDLK_UP)
-                camera.position.y += 3.0 * delta_time;
-            if (event.key.keysym.sym == SDLK_DOWN)
-                camera.position.y -= 3.0 * delta_time;
-            if (event.key.keysym.sym == SDLK_a)
-                camera.yaw -= 1.0 * delta_time;
-            if (event.key.keysym.sym == SDLK_d)
-                camera.yaw += 1.0 * delta_time;
-            if (event.key.keysym.sym == SDLK_w) {
-                camera.forward_velocity = vec3_mul(camera.direction, 5.0 * delta_time); 
-                camera.position = vec3_add(camera.position, camera.forward_velocity);
-            }
-            if (event.key.keysym.sym == SDLK_s) {
-                camera.forward_velocity = vec3_mul(camera.direction, 5.0 * delta_time); 
-                camera.position = vec3_sub(camera.position, camera.forward_velocity);
-            }
-            break;
+                break;
+            case SDL_KEYDOWN:
+                record_input_time(event_time(now, now_ms, event.key.timestamp));
+                if (event.key.keysym.sym == SDLK_ESCAPE)
+                    is_running = false;
+                if (event.key.keysym.sym == SDLK_1)
+                    render_method = RENDER_WIRE_VERTEX;
+                if (event.key.keysym.sym == SDLK_2)
+                    render_method = RENDER_WIRE;
+                if (event.key.keysym.sym == SDLK_3)
+                    render_method = RENDER_FILL_TRIANGLE;
+                if (event.key.keysym.sym == SDLK_4)
+                    render_method = RENDER_FILL_TRIANGLE_WIRE;
+                if (event.key.keysym.sym == SDLK_5)
+                    render_method = RENDER_TEXTURED;
+                if (event.key.keysym.sym == SDLK_6)
+                    render_method = RENDER_TEXTURED_WIRE;
+                if (event.key.keysym.sym == SDLK_7)
+                    render_method = RENDER_NORMALS;
+                if (event.key.keysym.sym == SDLK_8)
+                    render_method = RENDER_OVERDRAW;
+                if (event.key.keysym.sym == SDLK_9)
+                    render_method = RENDER_COST;
+                if (event.key.keysym.sym == SDLK_c)
+                    cull_method = CULL_BACKFACE;
+                if (event.key.keysym.sym == SDLK_d)
+                    cull_method = CULL_NONE;
+                if (event.key.keysym.sym == SDLK_f)
+                    shading_method = SHADING_FLAT;
+                if (event.key.keysym.sym == SDLK_g)
+                    shading_method = SHADING_GOURAUD;
+                if (event.key.keysym.sym == SDLK_h)
+                    is_hud_visible = !is_hud_visible;
+                break;
+            case SDL_KEYUP:
+                record_input_time(event_time(now, now_ms, event.key.timestamp));
+                break;
+        }
+    }
+
+    // Camera moves for as long as the keys are held, every frame, not just on key repeat
+    const Uint8 *keys = SDL_GetKeyboardState(NULL);
+    bool is_moving = false;
+    if (keys[SDL_SCANCODE_UP]) {
+        camera.position.y += 3.0 * delta_time;
+        is_moving = true;
+    }
+    if (keys[SDL_SCANCODE_DOWN]) {
+        camera.position.y -= 3.0 * delta_time;
+        is_moving = true;
+    }
+    if (keys[SDL_SCANCODE_A]) {
+        camera.yaw -= 1.0 * delta_time;
+        is_moving = true;
+    }
+    if (keys[SDL_SCANCODE_D]) {
+        camera.yaw += 1.0 * delta_time;
+        is_moving = true;
+    }
+    if (keys[SDL_SCANCODE_W]) {
+        camera.forward_velocity = vec3_mul(camera.direction, 5.0 * delta_time);
+        camera.position = vec3_add(camera.position, camera.forward_velocity);
+        is_moving = true;
+    }
+    if (keys[SDL_SCANCODE_S]) {
+        camera.forward_velocity = vec3_mul(camera.direction, 5.0 * delta_time);
+        camera.position = vec3_sub(camera.position, camera.forward_velocity);
+        is_moving = true;
+    }
+
+    // Held keys have no new events, the input was sampled now
+    if (is_moving)
+    {
+        record_input_time(now);
     }
 }
 
-void update(void)
+// Advance the animation state by dt seconds
+void simulate(float dt)
 {
-    // Release execution back to the CPU until we reach FRAME_TARGET_TIME to stabilise frame rate
-    int delay_ms = FRAME_TARGET_TIME - (SDL_GetTicks() - previous_frame_ms);
-    if (delay_ms > 0 && delay_ms <= FRAME_TARGET_TIME)
+    int n_instances = scene_num_instances();
+    for (int i = 0; i < n_instances; i++)
     {
-        SDL_Delay(delay_ms);
+        vec3_t old_rotation = scene.instances[i].rotation;
+        scene.instances[i].rotation.x += 0.0 * dt;
+        scene.instances[i].rotation.y += 0.0 * dt;
+        scene.instances[i].rotation.z += 0.0 * dt;
+
+        // Bounds are only refit when some transform actually changed
+        vec3_t rotation = scene.instances[i].rotation;
+        if (rotation.x != old_rotation.x || rotation.y != old_rotation.y || rotation.z != old_rotation.z)
+        {
+            scene.is_bvh_dirty = true;
+        }
     }
+}
 
-    delta_time = (SDL_GetTicks() - previous_frame_ms) / 1000.0f;
+void update(void)
+{
+    // Frame cost measured for the resolution controller, without the time spent waiting above
+    frame_start_time = get_time_seconds();
 
-    previous_frame_ms = SDL_GetTicks();
+    if (fixed_timestep > 0)
+    {
+        // Simulation runs at its own rate, independent of how fast we render
+        int steps = consume_simulation_steps(delta_time);
+        for (int i = 0; i < steps; i++)
+        {
+            simulate(fixed_timestep);
+        }
+    }
+    else
+    {
+        simulate(delta_time);
+    }
 
     triangles_to_render = NULL;
 
-    mesh.rotation.x += 0.0 * delta_time;
-    mesh.rotation.y += 0.0 * delta_time;
-    mesh.rotation.z += 0.0 * delta_time;
-    mesh.translation.z = 5.0;
-
     // Create view matrix
    
     // Initialize the target looking at the positive z-axis
@@ -161,113 +375,98 @@ void update(void)
     );
 
 
-    mat4_t scale_matrix = mat4_make_scale(mesh.scale.x, mesh.scale.y, mesh.scale.y);
-    mat4_t translation_matrix = mat4_make_translation(mesh.translation.x, mesh.translation.y, mesh.translation.z);
-    mat4_t rotation_matrix_x = mat4_make_rotation_x(mesh.rotation.x);
-    mat4_t rotation_matrix_y = mat4_make_rotation_y(mesh.rotation.y);
-    mat4_t rotation_matrix_z = mat4_make_rotation_z(mesh.rotation.z);
-    int n_faces = array_length(mesh.faces);
-    for (int i = 0; i < n_faces; i++)
+    bench_begin_stage(STAGE_CULL);
+    if (scene.is_bvh_dirty)
     {
-        face_t mesh_face = mesh.faces[i];
-
-        vec3_t face_vertices[3];
-        face_vertices[0] = mesh.vertices[mesh_face.a];
-        face_vertices[1] = mesh.vertices[mesh_face.b];
-        face_vertices[2] = mesh.vertices[mesh_face.c];
+        scene_refit_bvh();
+    }
 
+    // The view matrix takes world space to camera space, so the same transform
+    // gives the frustum planes in world space for the scene BVH
+    plane_equation_t world_planes[NUM_PLANES];
+    frustum_planes_to_object_space(view_matrix, world_planes);
 
-        vec4_t transformed_vertices[3];
+    array_free(visible_leaves);
+    visible_leaves = NULL;
+    bvh_query_frustum(&scene.bvh, world_planes, &visible_leaves);
+    bench_end_stage(STAGE_CULL);
 
-        // Loop over the vertices of the face
-        for (int j = 0; j < 3; j++)
+    int n_instances = scene_num_instances();
+    bench_begin_stage(STAGE_TRANSFORM);
+    if (is_shadow_mapping && scene.bvh.num_nodes > 0)
+    {
+        // The light looks at the whole scene, objects out of view still cast shadows into it
+        begin_shadow_frame(aabb_transform(scene.bvh.nodes[0].bounds, view_matrix));
+        for (int i = 0; i < n_instances; i++)
         {
-            vec4_t transformed_vertex = vec4_from_vec3(face_vertices[j]);
-
-            world_matrix = mat4_identity();
-            world_matrix = mat4_mul_mat4(scale_matrix, world_matrix);
-            world_matrix = mat4_mul_mat4(rotation_matrix_z, world_matrix);
-            world_matrix = mat4_mul_mat4(rotation_matrix_y, world_matrix);
-            world_matrix = mat4_mul_mat4(rotation_matrix_x, world_matrix);
-            world_matrix = mat4_mul_mat4(translation_matrix, world_matrix);
-
-            transformed_vertex = mat4_mul_vec4(world_matrix, transformed_vertex);
-            
-            transformed_vertex = mat4_mul_vec4(view_matrix, transformed_vertex);
-
-            transformed_vertices[j] = transformed_vertex;
+            mat4_t world_matrix = scene_instance_world_matrix(&scene.instances[i]);
+            draw_mesh_shadow_casters(&scene.meshes[scene.instances[i].mesh], &world_matrix, 1);
         }
+        for (int i = 0; i < array_length(scene.batches); i++)
+        {
+            instance_batch_t *batch = &scene.batches[i];
+            draw_mesh_shadow_casters(&scene.meshes[batch->mesh], batch->world_matrices, array_length(batch->world_matrices));
+        }
+    }
+    bench_end_stage(STAGE_TRANSFORM);
 
-        vec3_t vector_a = vec3_from_vec4(transformed_vertices[0]); /*   A   */
-        vec3_t vector_b = vec3_from_vec4(transformed_vertices[1]); /*  / \  */
-        vec3_t vector_c = vec3_from_vec4(transformed_vertices[2]); /* C---B */
-
-        vec3_t vector_ab = vec3_sub(vector_b, vector_a);
-        vec3_t vector_ac = vec3_sub(vector_c, vector_a);
-        vec3_normalize(&vector_ab);
-        vec3_normalize(&vector_ac);
-
-        // Compute the face normal (using cross product to find perpendicular)
-        vec3_t normal = vec3_cross(vector_ab, vector_ac);
-        vec3_normalize(&normal);
-
-        // Find the vector between vertex A in the triangle and the camera origin
-        vec3_t origin = {0, 0, 0};
-        vec3_t camera_ray = vec3_sub(origin, vector_a);
-
-        // Calculate how aligned the camera ray is with the face normal (using dot product)
-        float dot_normal_camera = vec3_dot(normal, camera_ray);
-
-        // Backface culling test to see if the current face should be projected
-        if (cull_method == CULL_BACKFACE) {
-            // Bypass the triangles that are looking away from the camera
-            if (dot_normal_camera < 0) {
-                continue;
+    bench_begin_stage(STAGE_CULL);
+    if (is_occlusion_culling)
+    {
+        // Large objects in view hide the ones behind them before anything is transformed
+        begin_occlusion_frame();
+        for (int i = 0; i < array_length(visible_leaves); i++)
+        {
+            bvh_node_t *leaf = &scene.bvh.nodes[visible_leaves[i]];
+            for (int j = 0; j < leaf->count; j++)
+            {
+                int item = scene.bvh.items[leaf->left_first + j];
+                if (item < n_instances)
+                {
+                    mat4_t world_matrix = scene_instance_world_matrix(&scene.instances[item]);
+                    draw_mesh_occluders(&scene.meshes[scene.instances[item].mesh], &world_matrix, 1);
+                    continue;
+                }
+
+                instance_batch_t *batch = &scene.batches[item - n_instances];
+                draw_mesh_occluders(&scene.meshes[batch->mesh], batch->world_matrices, array_length(batch->world_matrices));
             }
         }
+        finish_occluders();
+    }
+    bench_end_stage(STAGE_CULL);
 
-        vec4_t projected_vertices[3];
-
-        // Loop all three vertices to perform projection
-        for (int j = 0; j < 3; j++) {
-            // Project the current vertex
-            projected_vertices[j] = mat4_mul_vec4_project(projection_matrix, transformed_vertices[j]);
-
-            // Scale into the viewport
-            projected_vertices[j].x *= (window_width / 2);
-            projected_vertices[j].y *= (window_height / 2);
+    bench_begin_stage(STAGE_TRANSFORM);
+    for (int i = 0; i < array_length(visible_leaves); i++)
+    {
+        bvh_node_t *leaf = &scene.bvh.nodes[visible_leaves[i]];
+        for (int j = 0; j < leaf->count; j++)
+        {
+            int item = scene.bvh.items[leaf->left_first + j];
+            if (item < n_instances)
+            {
+                process_instance(&scene.instances[item]);
+                continue;
+            }
 
-            // Translate the projected points to the middle of the screen
-            projected_vertices[j].x += (window_width / 2);
-            projected_vertices[j].y += (window_height / 2);
+            instance_batch_t *batch = &scene.batches[item - n_instances];
+            draw_mesh_instanced(
+                &scene.meshes[batch->mesh],
+                batch->texture >= 0 ? &scene.textures[batch->texture] : NULL,
+                batch->world_matrices,
+                batch->lods,
+                array_length(batch->world_matrices));
         }
-
-        float avg_depth = (transformed_vertices[0].z + transformed_vertices[1].z + transformed_vertices[2].z) / 3;
-
-        float light_intensity_factor = -vec3_dot(normal, light.direction);
-
-        uint32_t triangle_color = light_apply_intensity(mesh_face.color, light_intensity_factor);
-
-        triangle_t projected_triangle = {
-            .vertices = {
-                { projected_vertices[0].x, projected_vertices[0].y, projected_vertices[0].z,  projected_vertices[0].w },
-                { projected_vertices[1].x, projected_vertices[1].y, projected_vertices[1].z,  projected_vertices[1].w },
-                { projected_vertices[2].x, projected_vertices[2].y, projected_vertices[2].z,  projected_vertices[2].w }
-            },
-            .texcoords = {
-                { mesh_face.a_uv.u, mesh_face.a_uv.v },
-                { mesh_face.b_uv.u, mesh_face.b_uv.v },
-                { mesh_face.c_uv.u, mesh_face.c_uv.v },
-            },
-            .color = triangle_color,
-            .avg_depth = avg_depth
-        };
-
-        array_push(triangles_to_render, projected_triangle);
     }
 
     int num_triangles = array_length(triangles_to_render);
 
+    // Local lights are culled per screen tile, so they can only be added once everything is projected
+    shade_triangles(triangles_to_render, num_triangles, view_matrix, projection_matrix, shading_method == SHADING_FLAT);
+    bench_end_stage(STAGE_TRANSFORM);
+
+    bench_begin_stage(STAGE_SORT);
+    trace_begin("sort");
     for (int i = 0; i < num_triangles; i++) {
         for (int j = i; j < num_triangles; j++) {
             if(triangles_to_render[i].avg_depth < triangles_to_render[j].avg_depth) {
@@ -277,83 +476,478 @@ void update(void)
             }
         }
     }
+    trace_end();
+    bench_end_stage(STAGE_SORT);
 }
 
 void render(void)
 {
-    SDL_RenderClear(renderer);
+    // Frames come back from the present queue or the locked texture with stale contents,
+    // so copy the background over whatever was drawn into them before
+    bench_begin_stage(STAGE_PRESENT);
+    trace_begin("begin_present_frame");
+    begin_present_frame();
+    trace_end();
+    bench_end_stage(STAGE_PRESENT);
 
-    draw_grid();
+    bench_begin_stage(STAGE_RASTER);
+    restore_background();
 
     int num_triangles = array_length(triangles_to_render);
-    for (int i = 0; i < num_triangles; i++)
-    {
-       triangle_t triangle = triangles_to_render[i];
 
-        if (render_method == RENDER_FILL_TRIANGLE || render_method == RENDER_FILL_TRIANGLE_WIRE) {
-            draw_filled_triangle(
-                triangle.vertices[0].x, triangle.vertices[0].y, // vertex A
-                triangle.vertices[1].x, triangle.vertices[1].y, // vertex B
-                triangle.vertices[2].x, triangle.vertices[2].y, // vertex C
-                triangle.color
-            );
-        }
+    // Filled and textured triangles can go through the G-buffer instead, only their outlines are left after it
+    bool is_textured = render_method == RENDER_TEXTURED || render_method == RENDER_TEXTURED_WIRE;
+    bool is_deferred = is_deferred_shading && (is_textured || render_method == RENDER_FILL_TRIANGLE || render_method == RENDER_FILL_TRIANGLE_WIRE);
+    if (is_deferred)
+    {
+        trace_begin("deferred");
+        draw_deferred_triangles(triangles_to_render, num_triangles, is_textured, shading_method == SHADING_GOURAUD);
+        trace_end();
+    }
 
-        if (render_method == RENDER_WIRE || render_method == RENDER_WIRE_VERTEX || render_method == RENDER_FILL_TRIANGLE_WIRE || render_method == RENDER_TEXTURED_WIRE) {
-            draw_triangle(
-                triangle.vertices[0].x, triangle.vertices[0].y, // vertex A
-                triangle.vertices[1].x, triangle.vertices[1].y, // vertex B
-                triangle.vertices[2].x, triangle.vertices[2].y, // vertex C
-                0xFFFFFFFF
-            );
-        }
+    // Heatmaps count what the fill writes on the side, and show that instead of the fill
+    bool is_heatmap = render_method == RENDER_OVERDRAW || render_method == RENDER_COST;
+    if (is_heatmap)
+    {
+        begin_heatmap(render_method == RENDER_OVERDRAW ? HEATMAP_OVERDRAW : HEATMAP_COST, num_triangles);
+    }
 
-        if(render_method == RENDER_TEXTURED || render_method == RENDER_TEXTURED_WIRE) {
-            draw_textured_triangle(
-                triangle.vertices[0].x, triangle.vertices[0].y, triangle.vertices[0].z, triangle.vertices[0].w, triangle.texcoords[0].u, triangle.texcoords[0].v, // vertex A
-                triangle.vertices[1].x, triangle.vertices[1].y, triangle.vertices[1].z, triangle.vertices[1].w, triangle.texcoords[1].u, triangle.texcoords[1].v, // vertex B
-                triangle.vertices[2].x, triangle.vertices[2].y, triangle.vertices[2].z, triangle.vertices[2].w, triangle.texcoords[2].u, triangle.texcoords[2].v, // vertex C
-                mesh_texture
-            );
-        }
+    trace_begin(render_method_names[render_method]);
+    draw_pipeline_triangles(get_pipeline_state(render_method, shading_method), triangles_to_render, num_triangles, !is_deferred);
+    trace_end();
 
-        if (render_method == RENDER_WIRE_VERTEX) {
-            draw_rect(triangle.vertices[0].x - 3, triangle.vertices[0].y - 3, 6, 6, 0xFFFF0000); // vertex A
-            draw_rect(triangle.vertices[1].x - 3, triangle.vertices[1].y - 3, 6, 6, 0xFFFF0000); // vertex B
-            draw_rect(triangle.vertices[2].x - 3, triangle.vertices[2].y - 3, 6, 6, 0xFFFF0000); // vertex C
-        }
+    if (is_heatmap)
+    {
+        draw_heatmap();
     }
+    bench_end_stage(STAGE_RASTER);
 
     array_free(triangles_to_render);
 
-    render_color_buffer();
+    // The HUD shows the counters of the frame before, this one is not finished yet
+    if (is_hud_visible)
+    {
+        draw_hud(last_frame_time_ms);
+    }
+
+    // Sampled before the present, which waits for the vblank with vsync and would
+    // make every frame look as long as the refresh period to the resolution controller
+    float build_time_ms = (get_time_seconds() - frame_start_time) * 1000.0;
+
+    bench_begin_stage(STAGE_PRESENT);
+    trace_begin("end_present_frame");
+    end_present_frame();
+    trace_end();
+    bench_end_stage(STAGE_PRESENT);
+
+    // The scale only changes once this frame is uploaded at the size it was drawn at
+    update_render_scale(build_time_ms, frame_target_time_ms());
+    float frame_time_ms = (get_time_seconds() - frame_start_time) * 1000.0;
+    finish_frame_stats(frame_time_ms);
+    last_frame_time_ms = frame_time_ms;
+}
 
-    clear_color_buffer(0xFF000000);
+// Everything of a frame after input, on the present queue's build thread when there is one
+void build_frame(void)
+{
+    trace_begin("update");
+    update();
+    trace_end();
 
-    SDL_RenderPresent(renderer);
+    trace_begin("render");
+    render();
+    trace_end();
+}
+
+// Scripted flight for the benchmark, towards the scene while swaying and turning, the same in every run
+void set_bench_camera(int frame, int num_frames)
+{
+    float t = (float)frame / num_frames;
+    camera.position = vec3_new(1.5 * sin(2 * M_PI * t), 0.5 * sin(4 * M_PI * t), -3.0 + 6.0 * t);
+    camera.yaw = 0.25 * sin(2 * M_PI * t);
+}
+
+static const char *cull_method_names[] = { "none", "backface" };
+static const char *shading_method_names[] = { "flat", "gouraud" };
+
+// Index of name in names, or -1 when it isn't one of them
+int find_name(const char *name, const char **names, int num_names)
+{
+    for (int i = 0; i < num_names; i++)
+    {
+        if (strcmp(name, names[i]) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Fly the same path over every model in ./assets, in every render method and cull method,
+// reloading the model for each run, and write the stage timings to bench_path
+void run_benchmark(void)
+{
+    char models[MAX_BENCH_MODELS][64];
+    int num_bench_models = find_bench_models(models);
+    int frames_per_run = frame_limit > 0 ? frame_limit : 30;
+
+    is_benchmarking = true;
+    for (int m = 0; m < num_bench_models; m++)
+    {
+        for (int cull = CULL_NONE; cull <= CULL_BACKFACE; cull++)
+        {
+            for (int method = RENDER_WIRE; method <= RENDER_NORMALS; method++)
+            {
+                bench_begin_run(models[m], render_method_names[method], cull_method_names[cull]);
+
+                free_scene();
+                free_local_lights();
+                model_names[0] = models[m];
+                num_models = 1;
+                bench_begin_stage(STAGE_LOAD);
+                load_scene();
+                place_lights();
+                bench_end_stage(STAGE_LOAD);
+
+                render_method = method;
+                cull_method = cull;
+                for (int frame = 0; frame < frames_per_run; frame++)
+                {
+                    set_bench_camera(frame, frames_per_run);
+                    delta_time = 1.0 / 60.0;
+                    build_frame();
+                    bench_end_frame();
+                }
+
+                bench_end_run();
+            }
+        }
+    }
+    is_benchmarking = false;
+
+    write_bench_results(bench_path, window_width, window_height, frames_per_run);
 }
 
 void free_resources(void)
 {
-    free(color_buffer);
-    upng_free(png_texture);
-    array_free(mesh.vertices);
-    array_free(mesh.faces);
+    free(back_buffer);
+    free_scene();
+    free_geometry();
+    free_occlusion();
+    free_shadow_map();
+    free_local_lights();
+    free_light_tiles();
+    free_deferred();
+    free_bench();
+    free_trace();
+    free_heatmap();
+    array_free(visible_leaves);
+    free_latency_samples();
+}
+
+void parse_arguments(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--copy-present") == 0)
+        {
+            // Rasterize into the malloc'd back buffer and upload it every frame
+            present_mode = PRESENT_COPY;
+        }
+        else if (strcmp(argv[i], "--present-queue") == 0 && i + 1 < argc)
+        {
+            // 2 or 3 frames in flight, presented 1 or 2 frames late, trading latency for throughput
+            present_queue_depth = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--render-scale") == 0 && i + 1 < argc)
+        {
+            // Fixed internal resolution as a fraction of the window size
+            render_scale = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--dynamic-resolution") == 0)
+        {
+            // Adjust the internal resolution to keep frames within the frame time target
+            is_dynamic_resolution = true;
+        }
+        else if (strcmp(argv[i], "--model") == 0 && i + 1 < argc)
+        {
+            // Name of a model in ./assets, can be given several times
+            if (num_models < MAX_MODELS)
+                model_names[num_models++] = argv[++i];
+            else
+                i++;
+        }
+        else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+        {
+            // Number of objects in the scene, cycling through the models
+            num_instances = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--lod") == 0 && i + 1 < argc)
+        {
+            // Number of detail levels to generate for every mesh, including the full one
+            num_mesh_lods = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--lod-radius") == 0 && i + 1 < argc)
+        {
+            // Screen radius in pixels below which meshes switch to their first simplified level
+            lod_switch_radius = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--gouraud") == 0)
+        {
+            // Light every vertex and interpolate across the triangles instead of one light per face
+            shading_method = SHADING_GOURAUD;
+        }
+        else if (strcmp(argv[i], "--point-lights") == 0 && i + 1 < argc)
+        {
+            // Number of point lights scattered over the scene, on top of the directional light
+            num_point_lights = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--spot-lights") == 0 && i + 1 < argc)
+        {
+            // Number of spot lights shining into the scene from the front
+            num_spot_lights = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--shadows") == 0)
+        {
+            // Shadows from the directional light, from a depth-only pass in the light's view
+            is_shadow_mapping = true;
+        }
+        else if (strcmp(argv[i], "--shadow-pcf") == 0)
+        {
+            // Blend four shadow map comparisons per lookup for softer shadow edges
+            is_shadow_mapping = true;
+            is_shadow_pcf = true;
+        }
+        else if (strcmp(argv[i], "--deferred") == 0)
+        {
+            // Rasterize into a G-buffer first and shade every pixel once, on all cores
+            is_deferred_shading = true;
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            // Worker threads for the deferred shading pass besides the main one, 0 shades on the main thread only
+            int count = atoi(argv[++i]);
+            if (count < 0)
+                fprintf(stderr, "Invalid thread count: %s, it must be 0 or more \n", argv[i]);
+            else
+                num_job_threads = count;
+        }
+        else if (strcmp(argv[i], "--occlusion") == 0)
+        {
+            // Skip objects hidden behind large ones, tested against a small depth buffer
+            is_occlusion_culling = true;
+        }
+        else if (strcmp(argv[i], "--occluder-radius") == 0 && i + 1 < argc)
+        {
+            // Screen radius in pixels an object needs to be drawn as an occluder
+            occluder_min_radius = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--no-clusters") == 0)
+        {
+            // Keep meshes whole instead of culling clusters of their faces on their own
+            is_mesh_clustered = false;
+        }
+        else if (strcmp(argv[i], "--instanced") == 0)
+        {
+            // Draw the copies of each model with one instanced call instead of separate objects
+            is_instanced = true;
+        }
+        else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc)
+        {
+            frame_pacing = PACING_CAPPED;
+            target_fps = atof(argv[++i]);
+            if (target_fps <= 0)
+            {
+                frame_pacing = PACING_UNCAPPED;
+                target_fps = 60;
+            }
+        }
+        else if (strcmp(argv[i], "--vsync") == 0)
+        {
+            frame_pacing = PACING_VSYNC;
+        }
+        else if (strcmp(argv[i], "--uncapped") == 0)
+        {
+            // Render as fast as possible, for benchmarking
+            frame_pacing = PACING_UNCAPPED;
+        }
+        else if (strcmp(argv[i], "--fixed-step") == 0 && i + 1 < argc)
+        {
+            // Simulation updates per second, decoupled from the render rate
+            float rate = atof(argv[++i]);
+            if (rate <= 0)
+                fprintf(stderr, "Invalid fixed step rate: %s, it must be more than 0 \n", argv[i]);
+            else
+                fixed_timestep = 1.0f / rate;
+        }
+        else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc)
+        {
+            // Run the benchmark suite offscreen and write its stage timings as JSON, --frames sets the frames per run
+            bench_path = argv[++i];
+            is_headless = true;
+        }
+        else if (strcmp(argv[i], "--stats-csv") == 0 && i + 1 < argc)
+        {
+            // Write the pipeline counters of every frame as a CSV row
+            stats_csv_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            // Record timing markers on every thread and write them as a Chrome trace-event file at exit
+            trace_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--hud") == 0)
+        {
+            // Start with the statistics overlay shown, H toggles it
+            is_hud_visible = true;
+        }
+        else if (strcmp(argv[i], "--render-method") == 0 && i + 1 < argc)
+        {
+            // Start in this render method, by its name in the benchmark results (wire, fill, textured, ...)
+            int method = find_name(argv[++i], render_method_names, NUM_RENDER_METHODS);
+            if (method < 0)
+                fprintf(stderr, "Unknown render method: %s \n", argv[i]);
+            else
+                render_method = method;
+        }
+        else if (strcmp(argv[i], "--cull") == 0 && i + 1 < argc)
+        {
+            // none or backface
+            int cull = find_name(argv[++i], cull_method_names, 2);
+            if (cull < 0)
+                fprintf(stderr, "Unknown cull method: %s \n", argv[i]);
+            else
+                cull_method = cull;
+        }
+        else if (strcmp(argv[i], "--shading") == 0 && i + 1 < argc)
+        {
+            // flat or gouraud
+            int shading = find_name(argv[++i], shading_method_names, 2);
+            if (shading < 0)
+                fprintf(stderr, "Unknown shading method: %s \n", argv[i]);
+            else
+                shading_method = shading;
+        }
+        else if (strcmp(argv[i], "--headless") == 0)
+        {
+            // Render offscreen at WIDTHxHEIGHT without opening a window
+            is_headless = true;
+            if (i + 1 < argc && sscanf(argv[i + 1], "%dx%d", &headless_width, &headless_height) == 2)
+            {
+                i++;
+            }
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            // Quit after rendering this many frames
+            frame_limit = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+        {
+            // Frame file pattern such as frame_%04d.png, the extension picks PNG or PPM
+            capture_path = argv[++i];
+            const char *extension = strrchr(capture_path, '.');
+            capture_format = (extension && strcmp(extension, ".png") == 0) ? CAPTURE_PNG : CAPTURE_PPM;
+        }
+        else if (strcmp(argv[i], "--raw-output") == 0 && i + 1 < argc)
+        {
+            // Stream raw RGBA frames to a file, or to stdout with "-"
+            capture_path = argv[++i];
+            capture_format = CAPTURE_RAW;
+        }
+        else if (strcmp(argv[i], "--min-scale") == 0 && i + 1 < argc)
+        {
+            resolution_config.min_scale = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--max-scale") == 0 && i + 1 < argc)
+        {
+            resolution_config.max_scale = atof(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "Unknown argument: %s \n", argv[i]);
+        }
+    }
 }
 
-int main(void)
+int main(int argc, char *argv[])
 {
-    is_running = initialize_window();
+    parse_arguments(argc, argv);
+
+    if (trace_path != NULL)
+    {
+        start_trace();
+        trace_thread_name("main");
+    }
+
+    if (is_headless)
+    {
+        is_running = initialize_headless(headless_width, headless_height);
+        if (frame_limit == 0 && bench_path == NULL)
+        {
+            frame_limit = 1;
+        }
+    }
+    else
+    {
+        is_running = initialize_window();
+    }
+
+    if (is_headless && capture_format != CAPTURE_NONE)
+    {
+        is_running = is_running && open_capture(capture_path, capture_format);
+    }
+
+    if (stats_csv_path != NULL)
+    {
+        is_running = is_running && open_stats_csv(stats_csv_path);
+    }
 
     setup();
+    start_present_queue(build_frame);
+
+    init_frame_pacing();
+
+    if (is_running && bench_path != NULL)
+    {
+        run_benchmark();
+        is_running = false;
+    }
 
+    int frame_count = 0;
     while (is_running)
     {
+        // Release execution back to the CPU until the next frame is due, then sample
+        // input right away so it is as fresh as possible when the frame is built
+        trace_begin("wait_for_next_frame");
+        delta_time = wait_for_next_frame();
+        trace_end();
+
+        trace_begin("process_input");
         process_input();
-        update();
-        render();
+        trace_end();
+
+        // Input is only handled while no frame is being built, the build thread reads what it changes
+        trace_begin("build_and_present_frame");
+        build_and_present_frame();
+        trace_end();
+
+        frame_count++;
+        if (frame_limit > 0 && frame_count >= frame_limit)
+        {
+            is_running = false;
+        }
     }
 
+    stop_present_queue();
+    stop_job_threads();
+    if (trace_path != NULL)
+    {
+        write_trace(trace_path);
+    }
+    close_capture();
+    close_stats_csv();
+    print_latency_stats();
     destroy_window();
     free_resources();
 
@@ -1,17 +1,11 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
 #include <string.h>
 #include "mesh.h"
 #include "array.h"
 #include "texture.h"
 
-mesh_t mesh = {
-    .vertices = NULL,
-    .faces = NULL,
-    .rotation = {0,0,0},
-    .scale = {1.0,1.0,1.0},
-    .translation = {0,0,0}
-};
-
 vec3_t cube_vertices[N_CUBE_VERTICES] = {
     { .x = -1, .y = -1, .z = -1 }, // 1
     { .x = -1, .y =  1, .z = -1 }, // 2
@@ -44,31 +38,44 @@ face_t cube_faces[N_CUBE_FACES] = {
     { .a = 6, .b = 1, .c = 4, .a_uv = { 0, 1 }, .b_uv = { 1, 0 }, .c_uv = { 1, 1 }, .color = 0xFFFFFFFF }
 };
 
-void load_cube_mesh_data(void) {
+void load_cube_mesh_data(mesh_t* mesh) {
     for (int i = 0; i < N_CUBE_VERTICES; i++) {
         vec3_t cube_vertex = cube_vertices[i];
-        array_push(mesh.vertices, cube_vertex);
+        array_push(mesh->vertices, cube_vertex);
     }
 
     for (int i = 0; i < N_CUBE_FACES; i++) {
+        // The table counts vertices from 1 like OBJ files do
         face_t cube_face = cube_faces[i];
-        array_push(mesh.faces, cube_face);
+        cube_face.a -= 1;
+        cube_face.b -= 1;
+        cube_face.c -= 1;
+        array_push(mesh->faces, cube_face);
     }
+
+    compute_face_planes(mesh->faces, mesh->vertices);
+    compute_smooth_normals(mesh);
+    compute_mesh_bounds(mesh);
 }
 
 
-void load_obj_file_data(char* filename) {
+bool load_obj_file_data(mesh_t* mesh, char* filename) {
     FILE* fileHandle;
     fileHandle = fopen(filename, "r");
+    if(fileHandle == NULL) {
+        fprintf(stderr, "Error opening mesh %s. \n", filename);
+        return false;
+    }
     char currentLine[1024];
 
     tex2_t* texcoords = NULL;
+    bool has_face_normals = true;
 
     while(fgets(currentLine, 1024, fileHandle)) {
         if(strncmp(currentLine, "v ", 2) == 0) {
             vec3_t vertex;
             sscanf(currentLine, "v %f %f %f", &vertex.x, &vertex.y, &vertex.z);
-            array_push(mesh.vertices, vertex);
+            array_push(mesh->vertices, vertex);
         }
 
         if(strncmp(currentLine, "vt ", 3) == 0) {
@@ -81,11 +88,18 @@ void load_obj_file_data(char* filename) {
             array_push(texcoords, texcoord);
         }
 
+        if(strncmp(currentLine, "vn ", 3) == 0) {
+            vec3_t normal;
+            sscanf(currentLine, "vn %f %f %f", &normal.x, &normal.y, &normal.z);
+            vec3_normalize(&normal);
+            array_push(mesh->normals, normal);
+        }
+
         if(strncmp(currentLine, "f ", 2) == 0) {
             int vertex_indices[3];
             int texture_indices[3];
             int normals_indices[3];
-            sscanf(
+            int num_read = sscanf(
                 currentLine, "f %d/%d/%d %d/%d/%d %d/%d/%d",
                 &vertex_indices[0], &texture_indices[0], &normals_indices[0],
                 &vertex_indices[1], &texture_indices[1], &normals_indices[1],
@@ -100,9 +114,203 @@ void load_obj_file_data(char* filename) {
                 .c_uv = texcoords[texture_indices[2] - 1],
                 .color = 0xFFFFFFFF
             };
-            array_push(mesh.faces, face);
+            if (num_read == 9) {
+                face.a_vn = normals_indices[0] - 1;
+                face.b_vn = normals_indices[1] - 1;
+                face.c_vn = normals_indices[2] - 1;
+            } else {
+                has_face_normals = false;
+            }
+            array_push(mesh->faces, face);
         }
     }
 
     array_free(texcoords);
+    fclose(fileHandle);
+
+    compute_face_planes(mesh->faces, mesh->vertices);
+    if (!has_face_normals || array_length(mesh->normals) == 0) {
+        compute_smooth_normals(mesh);
+    }
+    compute_mesh_bounds(mesh);
+    return true;
+}
+
+// Unit normal and plane constant of every face, so culling can test a face without its transformed vertices
+void compute_face_planes(face_t* faces, const vec3_t* vertices) {
+    int num_faces = array_length(faces);
+    for (int i = 0; i < num_faces; i++) {
+        vec3_t a = vertices[faces[i].a];
+        vec3_t ab = vec3_sub(vertices[faces[i].b], a);
+        vec3_t ac = vec3_sub(vertices[faces[i].c], a);
+        vec3_t normal = vec3_cross(ab, ac);
+        vec3_normalize(&normal);
+        faces[i].normal = normal;
+        faces[i].plane_d = -vec3_dot(normal, a);
+    }
+}
+
+// Replace the vertex normals with one per vertex, the area weighted average of the faces around it.
+// The faces' normal indices are pointed at their own vertices.
+void compute_smooth_normals(mesh_t* mesh) {
+    int num_vertices = array_length(mesh->vertices);
+    int num_faces = array_length(mesh->faces);
+
+    array_free(mesh->normals);
+    mesh->normals = NULL;
+    for (int i = 0; i < num_vertices; i++) {
+        vec3_t zero = { 0, 0, 0 };
+        array_push(mesh->normals, zero);
+    }
+
+    for (int i = 0; i < num_faces; i++) {
+        face_t* face = &mesh->faces[i];
+        vec3_t a = mesh->vertices[face->a];
+        vec3_t area_normal = vec3_cross(vec3_sub(mesh->vertices[face->b], a), vec3_sub(mesh->vertices[face->c], a));
+        mesh->normals[face->a] = vec3_add(mesh->normals[face->a], area_normal);
+        mesh->normals[face->b] = vec3_add(mesh->normals[face->b], area_normal);
+        mesh->normals[face->c] = vec3_add(mesh->normals[face->c], area_normal);
+        face->a_vn = face->a;
+        face->b_vn = face->b;
+        face->c_vn = face->c;
+    }
+
+    for (int i = 0; i < num_vertices; i++) {
+        vec3_normalize(&mesh->normals[i]);
+    }
+}
+
+// Bounding box of all vertices, and a sphere around its center reaching the furthest vertex
+void compute_mesh_bounds(mesh_t* mesh) {
+    int num_vertices = array_length(mesh->vertices);
+    vec3_t min = { 0, 0, 0 };
+    vec3_t max = { 0, 0, 0 };
+    for (int i = 0; i < num_vertices; i++) {
+        vec3_t v = mesh->vertices[i];
+        if (i == 0 || v.x < min.x) min.x = v.x;
+        if (i == 0 || v.y < min.y) min.y = v.y;
+        if (i == 0 || v.z < min.z) min.z = v.z;
+        if (i == 0 || v.x > max.x) max.x = v.x;
+        if (i == 0 || v.y > max.y) max.y = v.y;
+        if (i == 0 || v.z > max.z) max.z = v.z;
+    }
+
+    vec3_t center = {
+        (min.x + max.x) / 2,
+        (min.y + max.y) / 2,
+        (min.z + max.z) / 2
+    };
+    float radius = 0;
+    for (int i = 0; i < num_vertices; i++) {
+        float distance = vec3_length(vec3_sub(mesh->vertices[i], center));
+        if (distance > radius) radius = distance;
+    }
+
+    mesh->aabb_min = min;
+    mesh->aabb_max = max;
+    mesh->sphere_center = center;
+    mesh->sphere_radius = radius;
+}
+
+// Sphere around the cluster's vertices, and the narrowest cone around the average normal holding all face normals
+static void compute_cluster_bounds(const mesh_t* mesh, const face_t* faces, int num_faces, mesh_cluster_t* cluster) {
+    vec3_t min = mesh->vertices[faces[0].a];
+    vec3_t max = min;
+    vec3_t axis = { 0, 0, 0 };
+    for (int i = 0; i < num_faces; i++) {
+        int corners[3] = { faces[i].a, faces[i].b, faces[i].c };
+        for (int j = 0; j < 3; j++) {
+            vec3_t v = mesh->vertices[corners[j]];
+            min.x = v.x < min.x ? v.x : min.x;
+            min.y = v.y < min.y ? v.y : min.y;
+            min.z = v.z < min.z ? v.z : min.z;
+            max.x = v.x > max.x ? v.x : max.x;
+            max.y = v.y > max.y ? v.y : max.y;
+            max.z = v.z > max.z ? v.z : max.z;
+        }
+        axis = vec3_add(axis, faces[i].normal);
+    }
+
+    cluster->center = vec3_mul(vec3_add(min, max), 0.5);
+    cluster->radius = 0;
+    for (int i = 0; i < num_faces; i++) {
+        int corners[3] = { faces[i].a, faces[i].b, faces[i].c };
+        for (int j = 0; j < 3; j++) {
+            float distance = vec3_length(vec3_sub(mesh->vertices[corners[j]], cluster->center));
+            cluster->radius = distance > cluster->radius ? distance : cluster->radius;
+        }
+    }
+
+    vec3_normalize(&axis);
+    float min_dot = 1;
+    for (int i = 0; i < num_faces; i++) {
+        float d = vec3_dot(axis, faces[i].normal);
+        min_dot = d < min_dot ? d : min_dot;
+    }
+
+    // Cones of more than about 84 degrees (or degenerate axes) can't cull anything useful
+    cluster->cone_axis = axis;
+    cluster->cone_cutoff = (vec3_length(axis) < 0.5 || min_dot <= 0.1) ? 1 : sqrt(1 - min_dot * min_dot);
+}
+
+// Build a BVH over the faces with up to cluster_size faces per leaf, then reorder
+// the faces so every leaf covers a contiguous, spatially coherent range of them
+void build_mesh_clusters(mesh_t* mesh, int cluster_size) {
+    int num_faces = array_length(mesh->faces);
+    aabb_t* face_bounds = (aabb_t*)malloc(sizeof(aabb_t) * num_faces);
+    for (int i = 0; i < num_faces; i++) {
+        vec3_t a = mesh->vertices[mesh->faces[i].a];
+        vec3_t b = mesh->vertices[mesh->faces[i].b];
+        vec3_t c = mesh->vertices[mesh->faces[i].c];
+        aabb_t box = { a, a };
+        aabb_t point_b = { b, b };
+        aabb_t point_c = { c, c };
+        face_bounds[i] = aabb_union(aabb_union(box, point_b), point_c);
+    }
+
+    bvh_build(&mesh->clusters, face_bounds, num_faces, cluster_size);
+
+    face_t* sorted_faces = (face_t*)malloc(sizeof(face_t) * num_faces);
+    for (int i = 0; i < num_faces; i++) {
+        sorted_faces[i] = mesh->faces[mesh->clusters.items[i]];
+    }
+    for (int i = 0; i < num_faces; i++) {
+        mesh->faces[i] = sorted_faces[i];
+        mesh->clusters.items[i] = i;
+    }
+
+    free(sorted_faces);
+    free(face_bounds);
+
+    free(mesh->cluster_bounds);
+    mesh->cluster_bounds = (mesh_cluster_t*)calloc(mesh->clusters.num_nodes, sizeof(mesh_cluster_t));
+    for (int i = 0; i < mesh->clusters.num_nodes; i++) {
+        bvh_node_t* node = &mesh->clusters.nodes[i];
+        if (node->count > 0) {
+            compute_cluster_bounds(mesh, &mesh->faces[node->left_first], node->count, &mesh->cluster_bounds[i]);
+        }
+    }
+}
+
+// Is the camera behind every face of the cluster
+bool is_cluster_backfacing(const mesh_cluster_t* cluster, vec3_t eye) {
+    vec3_t to_center = vec3_sub(cluster->center, eye);
+    return vec3_dot(to_center, cluster->cone_axis) >= cluster->cone_cutoff * vec3_length(to_center) + cluster->radius;
+}
+
+void free_mesh(mesh_t* mesh) {
+    bvh_free(&mesh->clusters);
+    free(mesh->cluster_bounds);
+    mesh->cluster_bounds = NULL;
+    for (int i = 0; i < mesh->num_lods - 1; i++) {
+        array_free(mesh->lods[i]);
+        mesh->lods[i] = NULL;
+    }
+    mesh->num_lods = 0;
+    array_free(mesh->vertices);
+    array_free(mesh->normals);
+    array_free(mesh->faces);
+    mesh->vertices = NULL;
+    mesh->normals = NULL;
+    mesh->faces = NULL;
 }
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <stdbool.h>
 #include "vector.h"
 #include "triangle.h"
+#include "bvh.h"
 
 #define N_CUBE_VERTICES 8
 extern vec3_t cube_vertices[N_CUBE_VERTICES];
@@ -9,15 +11,44 @@ extern vec3_t cube_vertices[N_CUBE_VERTICES];
 #define N_CUBE_FACES (6 * 2) // 6 cube faces, 2 triangles per face
 extern face_t cube_faces[N_CUBE_FACES];
 
+///////////////////////////////////////////////////////////////////////////////
+// Meshlet culling data, one per node of the cluster BVH (only leaves use it).
+// Every face of the cluster has its normal within the cone around cone_axis,
+// so the whole cluster faces away from a camera at eye when
+//
+//   dot(center - eye, cone_axis) >= cone_cutoff * |center - eye| + radius
+//
+// A cone_cutoff of 1 never passes, the normals are too spread out to tell.
+///////////////////////////////////////////////////////////////////////////////
+typedef struct {
+    vec3_t center;
+    float radius;
+    vec3_t cone_axis;
+    float cone_cutoff;
+} mesh_cluster_t;
+
+// Full resolution mesh plus up to 3 simplified levels
+#define MAX_MESH_LODS 4
+
 typedef struct {
     vec3_t* vertices;
+    vec3_t* normals;        // Unit vertex normals, from the file's vn lines or generated smooth ones
     face_t* faces;
-    vec3_t rotation;
-    vec3_t scale;
-    vec3_t translation;
+    vec3_t aabb_min;        // Object space bounding box
+    vec3_t aabb_max;
+    vec3_t sphere_center;   // Object space bounding sphere
+    float sphere_radius;
+    bvh_t clusters;         // Optional hierarchy over clusters of faces, empty when not built
+    mesh_cluster_t* cluster_bounds; // Bounding sphere and normal cone of every clusters node
+    face_t* lods[MAX_MESH_LODS - 1]; // Faces of the simplified levels 1.., they index the same vertices
+    int num_lods;           // Levels including the full mesh, 0 or 1 when no LODs were generated
 } mesh_t;
 
-extern mesh_t mesh;
-
-void load_cube_mesh_data(void);
-void load_obj_file_data(char* filename);
+void load_cube_mesh_data(mesh_t* mesh);
+bool load_obj_file_data(mesh_t* mesh, char* filename);
+void compute_mesh_bounds(mesh_t* mesh);
+void compute_face_planes(face_t* faces, const vec3_t* vertices);
+void compute_smooth_normals(mesh_t* mesh);
+void build_mesh_clusters(mesh_t* mesh, int cluster_size);
+bool is_cluster_backfacing(const mesh_cluster_t* cluster, vec3_t eye);
+void free_mesh(mesh_t* mesh);
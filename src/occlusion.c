@@ -0,0 +1,192 @@
+#include <stdlib.h>
+#include "occlusion.h"
+#include "array.h"
+
+bool is_occlusion_culling = false;
+float occluder_min_radius = 48.0;
+int num_occluded_objects = 0;
+
+// Same distance as the projection's near plane, anything closer is not rasterized
+#define OCCLUSION_NEAR 0.1
+
+#define TILES_X (OCCLUSION_WIDTH / OCCLUSION_TILE_SIZE)
+#define TILES_Y (OCCLUSION_HEIGHT / OCCLUSION_TILE_SIZE)
+
+static depth_buffer_t occlusion_buffer = { 0, 0, NULL };
+// Farthest and nearest depth of every tile, a tile with an empty pixel has a farthest depth of 0
+static float tile_min_depth[TILES_Y][TILES_X];
+static float tile_max_depth[TILES_Y][TILES_X];
+static bool has_occluders = false;
+// Row minimums of the buffer, the first half of the erosion
+static float row_min_depth[OCCLUSION_HEIGHT][OCCLUSION_WIDTH];
+
+// Occluder vertices in buffer coordinates, z holds 1/w and is 0 for vertices in front of the near plane
+static vec3_t* screen_vertices = NULL;
+static int screen_vertices_capacity = 0;
+
+void begin_occlusion_frame(void) {
+    if (occlusion_buffer.depth == NULL) {
+        init_depth_buffer(&occlusion_buffer, OCCLUSION_WIDTH, OCCLUSION_HEIGHT);
+    }
+    clear_depth_buffer(&occlusion_buffer);
+    has_occluders = false;
+    num_occluded_objects = 0;
+}
+
+// View space point to buffer pixels, with y growing downwards like the screen
+static vec3_t project_to_buffer(vec4_t view, mat4_t projection) {
+    vec4_t clip = mat4_mul_vec4(projection, view);
+    vec3_t result = {
+        (clip.x / clip.w + 1) * 0.5 * OCCLUSION_WIDTH,
+        (1 - clip.y / clip.w) * 0.5 * OCCLUSION_HEIGHT,
+        1 / clip.w
+    };
+    return result;
+}
+
+// Back faces are drawn too, on a closed mesh they are always behind the front ones
+void draw_occluder(const mesh_t* mesh, mat4_t model_view, mat4_t projection) {
+    int num_vertices = array_length(mesh->vertices);
+    if (num_vertices > screen_vertices_capacity) {
+        screen_vertices_capacity = num_vertices;
+        screen_vertices = (vec3_t*)realloc(screen_vertices, sizeof(vec3_t) * num_vertices);
+    }
+
+    for (int i = 0; i < num_vertices; i++) {
+        vec4_t view = mat4_mul_vec4(model_view, vec4_from_vec3(mesh->vertices[i]));
+        if (view.z < OCCLUSION_NEAR) {
+            screen_vertices[i].z = 0;
+            continue;
+        }
+        screen_vertices[i] = project_to_buffer(view, projection);
+    }
+
+    int num_faces = array_length(mesh->faces);
+    for (int i = 0; i < num_faces; i++) {
+        vec3_t a = screen_vertices[mesh->faces[i].a];
+        vec3_t b = screen_vertices[mesh->faces[i].b];
+        vec3_t c = screen_vertices[mesh->faces[i].c];
+        // Dropping a clipped triangle only makes the buffer hide less, never more
+        if (a.z == 0 || b.z == 0 || c.z == 0) {
+            continue;
+        }
+        draw_depth_triangle(&occlusion_buffer, a, b, c);
+    }
+    has_occluders = true;
+}
+
+// Every pixel takes the farthest depth of itself and its 8 neighbors. Coverage is sampled at
+// pixel centers, so a pixel on an occluder's outline can hold its depth while part of the pixel
+// is open. Such a pixel always has a neighbor whose center is open, and after this it is open
+// too. Depths within a pixel only get farther from the neighbors' centers as well.
+static void erode_occlusion_buffer(void) {
+    int width = occlusion_buffer.width;
+    for (int y = 0; y < OCCLUSION_HEIGHT; y++) {
+        const float* row = &occlusion_buffer.depth[y * width];
+        for (int x = 0; x < OCCLUSION_WIDTH; x++) {
+            float depth = row[x];
+            if (x > 0 && row[x - 1] < depth) depth = row[x - 1];
+            if (x < OCCLUSION_WIDTH - 1 && row[x + 1] < depth) depth = row[x + 1];
+            row_min_depth[y][x] = depth;
+        }
+    }
+    for (int y = 0; y < OCCLUSION_HEIGHT; y++) {
+        float* row = &occlusion_buffer.depth[y * width];
+        for (int x = 0; x < OCCLUSION_WIDTH; x++) {
+            float depth = row_min_depth[y][x];
+            if (y > 0 && row_min_depth[y - 1][x] < depth) depth = row_min_depth[y - 1][x];
+            if (y < OCCLUSION_HEIGHT - 1 && row_min_depth[y + 1][x] < depth) depth = row_min_depth[y + 1][x];
+            row[x] = depth;
+        }
+    }
+}
+
+void finish_occluders(void) {
+    erode_occlusion_buffer();
+
+    for (int ty = 0; ty < TILES_Y; ty++) {
+        for (int tx = 0; tx < TILES_X; tx++) {
+            float min_depth = occlusion_buffer.depth[ty * OCCLUSION_TILE_SIZE * occlusion_buffer.width + tx * OCCLUSION_TILE_SIZE];
+            float max_depth = min_depth;
+            for (int y = 0; y < OCCLUSION_TILE_SIZE; y++) {
+                float* row = &occlusion_buffer.depth[(ty * OCCLUSION_TILE_SIZE + y) * occlusion_buffer.width + tx * OCCLUSION_TILE_SIZE];
+                for (int x = 0; x < OCCLUSION_TILE_SIZE; x++) {
+                    min_depth = row[x] < min_depth ? row[x] : min_depth;
+                    max_depth = row[x] > max_depth ? row[x] : max_depth;
+                }
+            }
+            tile_min_depth[ty][tx] = min_depth;
+            tile_max_depth[ty][tx] = max_depth;
+        }
+    }
+}
+
+// Hidden when every pixel under the screen rectangle of the bounding box holds an occluder
+// nearer than the nearest corner of the box. Whole tiles are decided from their farthest and
+// nearest depth, only tiles with the object in between are checked pixel by pixel.
+bool is_occluded(const mesh_t* mesh, mat4_t model_view, mat4_t projection) {
+    if (!has_occluders) {
+        return false;
+    }
+
+    float min_x = OCCLUSION_WIDTH, min_y = OCCLUSION_HEIGHT, max_x = 0, max_y = 0;
+    float nearest = 0;
+    for (int i = 0; i < 8; i++) {
+        vec3_t corner = {
+            (i & 1) ? mesh->aabb_max.x : mesh->aabb_min.x,
+            (i & 2) ? mesh->aabb_max.y : mesh->aabb_min.y,
+            (i & 4) ? mesh->aabb_max.z : mesh->aabb_min.z
+        };
+        vec4_t view = mat4_mul_vec4(model_view, vec4_from_vec3(corner));
+        if (view.z < OCCLUSION_NEAR) {
+            return false; // The box reaches the camera
+        }
+        vec3_t p = project_to_buffer(view, projection);
+        min_x = p.x < min_x ? p.x : min_x;
+        min_y = p.y < min_y ? p.y : min_y;
+        max_x = p.x > max_x ? p.x : max_x;
+        max_y = p.y > max_y ? p.y : max_y;
+        nearest = p.z > nearest ? p.z : nearest;
+    }
+
+    int x0 = min_x < 0 ? 0 : (int)min_x;
+    int y0 = min_y < 0 ? 0 : (int)min_y;
+    int x1 = max_x > OCCLUSION_WIDTH - 1 ? OCCLUSION_WIDTH - 1 : (int)max_x;
+    int y1 = max_y > OCCLUSION_HEIGHT - 1 ? OCCLUSION_HEIGHT - 1 : (int)max_y;
+    if (x0 > x1 || y0 > y1) {
+        return false;
+    }
+
+    for (int ty = y0 / OCCLUSION_TILE_SIZE; ty <= y1 / OCCLUSION_TILE_SIZE; ty++) {
+        for (int tx = x0 / OCCLUSION_TILE_SIZE; tx <= x1 / OCCLUSION_TILE_SIZE; tx++) {
+            if (tile_min_depth[ty][tx] > nearest) {
+                continue; // Whole tile in front of the object
+            }
+            if (tile_max_depth[ty][tx] <= nearest) {
+                return false; // Nothing in the tile is in front of the object
+            }
+
+            int px0 = tx * OCCLUSION_TILE_SIZE > x0 ? tx * OCCLUSION_TILE_SIZE : x0;
+            int py0 = ty * OCCLUSION_TILE_SIZE > y0 ? ty * OCCLUSION_TILE_SIZE : y0;
+            int px1 = (tx + 1) * OCCLUSION_TILE_SIZE - 1 < x1 ? (tx + 1) * OCCLUSION_TILE_SIZE - 1 : x1;
+            int py1 = (ty + 1) * OCCLUSION_TILE_SIZE - 1 < y1 ? (ty + 1) * OCCLUSION_TILE_SIZE - 1 : y1;
+            for (int y = py0; y <= py1; y++) {
+                for (int x = px0; x <= px1; x++) {
+                    if (occlusion_buffer.depth[y * occlusion_buffer.width + x] <= nearest) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+
+    num_occluded_objects++;
+    return true;
+}
+
+void free_occlusion(void) {
+    free_depth_buffer(&occlusion_buffer);
+    free(screen_vertices);
+    screen_vertices = NULL;
+    screen_vertices_capacity = 0;
+}
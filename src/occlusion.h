@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include "matrix.h"
+#include "mesh.h"
+#include "depth.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Occlusion culling
+///////////////////////////////////////////////////////////////////////////////
+// Large objects near the camera are rasterized first, depth only, into a
+// small buffer. An object is hidden when the nearest point of its bounding box
+// is behind the buffer everywhere under its screen rectangle. The farthest and
+// nearest depth of every 8x8 tile decide most tiles without reading pixels.
+//
+//   begin_occlusion_frame()  ->  draw_occluder() ...  ->  finish_occluders()
+//   ->  is_occluded() for every object before the geometry stage
+//
+// Only instances covering at least occluder_min_radius pixels are drawn as
+// occluders, smaller ones hide too little to pay for themselves.
+//
+// The buffer is kept conservative: occluders are sampled at pixel centers, then
+// finish_occluders() erodes them by a pixel, so a low resolution pixel only
+// counts as covered when it and its neighbors are. Each of them spans several
+// screen pixels, so occluders lose about one of them all around their outline.
+// Gaps narrower than a pixel between occluders that fall between pixel
+// centers are the remaining way to hide too much.
+///////////////////////////////////////////////////////////////////////////////
+#define OCCLUSION_WIDTH 256
+#define OCCLUSION_HEIGHT 128
+#define OCCLUSION_TILE_SIZE 8
+
+extern bool is_occlusion_culling;
+extern float occluder_min_radius;
+extern int num_occluded_objects;
+
+void begin_occlusion_frame(void);
+void draw_occluder(const mesh_t* mesh, mat4_t model_view, mat4_t projection);
+void finish_occluders(void);
+bool is_occluded(const mesh_t* mesh, mat4_t model_view, mat4_t projection);
+void free_occlusion(void);
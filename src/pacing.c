@@ -0,0 +1,115 @@
+#include <SDL2/SDL.h>
+#include "pacing.h"
+#include "display.h"
+
+enum frame_pacing frame_pacing = PACING_CAPPED;
+float target_fps = 60;
+
+// Seconds per simulation step, 0 advances the simulation by the frame time instead
+float fixed_timestep = 0;
+
+// Don't try to catch up forever after a long stall (like dragging the window)
+#define MAX_SIMULATION_STEPS 8
+
+static uint64_t counter_frequency = 0;
+static uint64_t previous_frame_counter = 0;
+static uint64_t next_frame_counter = 0;
+static float simulation_accumulator = 0;
+static int display_refresh_rate = 60;
+
+void init_frame_pacing(void)
+{
+    counter_frequency = SDL_GetPerformanceFrequency();
+    previous_frame_counter = SDL_GetPerformanceCounter();
+    next_frame_counter = previous_frame_counter;
+    simulation_accumulator = 0;
+
+    if (!is_headless)
+    {
+        SDL_DisplayMode display_mode;
+        if (SDL_GetCurrentDisplayMode(0, &display_mode) == 0 && display_mode.refresh_rate > 0)
+        {
+            display_refresh_rate = display_mode.refresh_rate;
+        }
+    }
+}
+
+double get_time_seconds(void)
+{
+    return (double)SDL_GetPerformanceCounter() / (double)counter_frequency;
+}
+
+// Time budget of one frame, what the resolution controller aims for
+float frame_target_time_ms(void)
+{
+    if (frame_pacing == PACING_VSYNC)
+    {
+        return 1000.0f / display_refresh_rate;
+    }
+    return 1000.0f / target_fps;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Wait until the next frame is due and return the seconds since the last one
+///////////////////////////////////////////////////////////////////////////////
+// SDL_Delay only has millisecond granularity and often oversleeps by one or
+// two, so we sleep until about 2ms before the deadline and spin on the
+// performance counter for the rest. Deadlines are advanced by whole periods
+// so timing errors don't accumulate, unless we fell more than a frame behind.
+///////////////////////////////////////////////////////////////////////////////
+float wait_for_next_frame(void)
+{
+    if (is_headless)
+    {
+        // Same simulated time every run, regardless of how long frames really take
+        return 1.0f / target_fps;
+    }
+
+    if (frame_pacing == PACING_CAPPED)
+    {
+        uint64_t period = (uint64_t)(counter_frequency / target_fps);
+        uint64_t sleep_margin = counter_frequency / 500;
+
+        next_frame_counter += period;
+        uint64_t now = SDL_GetPerformanceCounter();
+        if (now > next_frame_counter + period)
+        {
+            next_frame_counter = now;
+        }
+
+        while (now + sleep_margin < next_frame_counter)
+        {
+            uint32_t delay_ms = (uint32_t)(((next_frame_counter - now - sleep_margin) * 1000) / counter_frequency);
+            SDL_Delay(delay_ms > 0 ? delay_ms : 1);
+            now = SDL_GetPerformanceCounter();
+        }
+        while (now < next_frame_counter)
+        {
+            now = SDL_GetPerformanceCounter();
+        }
+    }
+
+    uint64_t now = SDL_GetPerformanceCounter();
+    float elapsed = (float)(now - previous_frame_counter) / counter_frequency;
+    previous_frame_counter = now;
+    return elapsed;
+}
+
+// Number of fixed simulation steps to run this frame, keeping the remainder for the next one
+int consume_simulation_steps(float elapsed)
+{
+    simulation_accumulator += elapsed;
+
+    int steps = 0;
+    while (simulation_accumulator >= fixed_timestep && steps < MAX_SIMULATION_STEPS)
+    {
+        simulation_accumulator -= fixed_timestep;
+        steps++;
+    }
+    if (steps == MAX_SIMULATION_STEPS)
+    {
+        simulation_accumulator = 0;
+    }
+
+    return steps;
+}
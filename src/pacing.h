@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+enum frame_pacing {
+    PACING_CAPPED,   // Sleep until the next frame at target_fps
+    PACING_VSYNC,    // Let SDL_RenderPresent block on the display refresh
+    PACING_UNCAPPED  // Never wait, for measuring throughput
+};
+
+extern enum frame_pacing frame_pacing;
+extern float target_fps;
+extern float fixed_timestep;
+
+void init_frame_pacing(void);
+double get_time_seconds(void);
+float frame_target_time_ms(void);
+float wait_for_next_frame(void);
+int consume_simulation_steps(float elapsed);
@@ -0,0 +1,153 @@
+#include <stdlib.h>
+#include "pipeline.h"
+#include "raster.h"
+#include "display.h"
+#include "light.h"
+#include "stats.h"
+#include "heatmap.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Built-in shaders
+///////////////////////////////////////////////////////////////////////////////
+
+static uint32_t sample_texture(const texture_t *texture, float u, float v) {
+    STAT_ADD(texels_fetched, 1);
+    int tex_x = abs((int)(u * texture->width)) % texture->width;
+    int tex_y = abs((int)(v * texture->height)) % texture->height;
+    return texture->texels[(texture->width * tex_y) + tex_x];
+}
+
+// Gouraud: the light intensity of each vertex, applied by the rasterizer
+static void intensity_vertex(const triangle_t *triangle, int vertex, float *varyings) {
+    varyings[0] = triangle->intensities[vertex];
+}
+
+static uint32_t color_fragment(const uniforms_t *uniforms, const float *varyings) {
+    (void)varyings;
+    return uniforms->color;
+}
+
+// Flat shaded textures: one light level for the whole triangle
+static void texcoord_vertex(const triangle_t *triangle, int vertex, float *varyings) {
+    varyings[0] = triangle->texcoords[vertex].u;
+    varyings[1] = triangle->texcoords[vertex].v;
+}
+
+static uint32_t flat_texture_fragment(const uniforms_t *uniforms, const float *varyings) {
+    return light_apply_level(sample_texture(uniforms->texture, varyings[0], varyings[1]), uniforms->level);
+}
+
+// Gouraud shaded textures: the intensity is interpolated with the texture coordinates
+static void texcoord_intensity_vertex(const triangle_t *triangle, int vertex, float *varyings) {
+    varyings[0] = triangle->texcoords[vertex].u;
+    varyings[1] = triangle->texcoords[vertex].v;
+    varyings[2] = triangle->intensities[vertex];
+}
+
+static uint32_t texture_fragment(const uniforms_t *uniforms, const float *varyings) {
+    return sample_texture(uniforms->texture, varyings[0], varyings[1]);
+}
+
+// View space normals as colors, x, y and z to red, green and blue
+static void normal_vertex(const triangle_t *triangle, int vertex, float *varyings) {
+    varyings[0] = triangle->normals[vertex].x;
+    varyings[1] = triangle->normals[vertex].y;
+    varyings[2] = triangle->normals[vertex].z;
+}
+
+static uint32_t normal_fragment(const uniforms_t *uniforms, const float *varyings) {
+    (void)uniforms;
+    uint32_t channels[3];
+    for (int i = 0; i < 3; i++) {
+        float channel = varyings[i] * 0.5 + 0.5;
+        channels[i] = channel < 0 ? 0 : channel > 1 ? 255 : (uint32_t)(channel * 255);
+    }
+    return 0xFF000000 | (channels[0] << 16) | (channels[1] << 8) | channels[2];
+}
+
+DEFINE_RASTERIZER(fill_gouraud, 1, false, 0, intensity_vertex, color_fragment)
+DEFINE_RASTERIZER(fill_flat_texture, 2, true, -1, texcoord_vertex, flat_texture_fragment)
+DEFINE_RASTERIZER(fill_gouraud_texture, 3, true, 2, texcoord_intensity_vertex, texture_fragment)
+DEFINE_RASTERIZER(fill_normals, 3, true, -1, normal_vertex, normal_fragment)
+
+// A single color needs no shaders at all, whole spans are filled with it
+static void fill_flat(const triangle_t *triangle) {
+    draw_filled_triangle(
+        triangle->vertices[0].x, triangle->vertices[0].y,
+        triangle->vertices[1].x, triangle->vertices[1].y,
+        triangle->vertices[2].x, triangle->vertices[2].y,
+        triangle->color
+    );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Pipeline states, one per render mode and shading
+///////////////////////////////////////////////////////////////////////////////
+const char *render_method_names[] = { "wire", "wire_vertex", "fill", "fill_wire", "textured", "textured_wire", "normals", "overdraw", "cost" };
+
+static const pipeline_state_t wire_state = { NULL, false, true, false };
+static const pipeline_state_t wire_vertex_state = { NULL, false, true, true };
+static const pipeline_state_t flat_state = { fill_flat, false, false, false };
+static const pipeline_state_t flat_wire_state = { fill_flat, false, true, false };
+static const pipeline_state_t gouraud_state = { fill_gouraud, false, false, false };
+static const pipeline_state_t gouraud_wire_state = { fill_gouraud, false, true, false };
+static const pipeline_state_t flat_texture_state = { fill_flat_texture, true, false, false };
+static const pipeline_state_t flat_texture_wire_state = { fill_flat_texture, true, true, false };
+static const pipeline_state_t gouraud_texture_state = { fill_gouraud_texture, true, false, false };
+static const pipeline_state_t gouraud_texture_wire_state = { fill_gouraud_texture, true, true, false };
+static const pipeline_state_t normals_state = { fill_normals, false, false, false };
+
+const pipeline_state_t *get_pipeline_state(enum render_method render_method, enum shading_method shading_method) {
+    bool is_gouraud = shading_method == SHADING_GOURAUD;
+    switch (render_method) {
+        case RENDER_WIRE: return &wire_state;
+        case RENDER_WIRE_VERTEX: return &wire_vertex_state;
+        case RENDER_FILL_TRIANGLE: return is_gouraud ? &gouraud_state : &flat_state;
+        case RENDER_FILL_TRIANGLE_WIRE: return is_gouraud ? &gouraud_wire_state : &flat_wire_state;
+        case RENDER_TEXTURED: return is_gouraud ? &gouraud_texture_state : &flat_texture_state;
+        case RENDER_TEXTURED_WIRE: return is_gouraud ? &gouraud_texture_wire_state : &flat_texture_wire_state;
+        case RENDER_NORMALS: return &normals_state;
+        // Heatmaps measure the plain fill, their colors replace it afterwards
+        case RENDER_OVERDRAW:
+        case RENDER_COST: return is_gouraud ? &gouraud_state : &flat_state;
+    }
+    return &wire_state;
+}
+
+// Fill, outline and vertex points of every triangle in order. The fill is left out when
+// another pass drew it already.
+void draw_pipeline_triangles(const pipeline_state_t *state, const triangle_t *triangles, int num_triangles, bool is_filled) {
+    for (int i = 0; i < num_triangles; i++) {
+        const triangle_t *triangle = &triangles[i];
+
+        if (is_filled && state->fill != NULL) {
+            if (!state->needs_texture || (triangle->texture != NULL && triangle->texture->texels != NULL)) {
+                STAT_ADD(triangles_rasterized, 1);
+                if (heatmap_method != HEATMAP_NONE) {
+                    begin_heat_triangle(i);
+                    state->fill(triangle);
+                    end_heat_triangle();
+                } else {
+                    state->fill(triangle);
+                }
+            }
+        } else if (state->fill == NULL && state->has_wireframe) {
+            STAT_ADD(triangles_rasterized, 1);
+        }
+
+        if (state->has_wireframe) {
+            draw_triangle(
+                triangle->vertices[0].x, triangle->vertices[0].y, // vertex A
+                triangle->vertices[1].x, triangle->vertices[1].y, // vertex B
+                triangle->vertices[2].x, triangle->vertices[2].y, // vertex C
+                0xFFFFFFFF
+            );
+        }
+
+        if (state->has_vertex_points) {
+            draw_rect(triangle->vertices[0].x - 3, triangle->vertices[0].y - 3, 6, 6, 0xFFFF0000); // vertex A
+            draw_rect(triangle->vertices[1].x - 3, triangle->vertices[1].y - 3, 6, 6, 0xFFFF0000); // vertex B
+            draw_rect(triangle->vertices[2].x - 3, triangle->vertices[2].y - 3, 6, 6, 0xFFFF0000); // vertex C
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "geometry.h"
+#include "texture.h"
+#include "triangle.h"
+
+enum render_method {
+    RENDER_WIRE,
+    RENDER_WIRE_VERTEX,
+    RENDER_FILL_TRIANGLE,
+    RENDER_FILL_TRIANGLE_WIRE,
+    RENDER_TEXTURED,
+    RENDER_TEXTURED_WIRE,
+    RENDER_NORMALS,
+    RENDER_OVERDRAW,
+    RENDER_COST
+};
+
+#define NUM_RENDER_METHODS (RENDER_COST + 1)
+
+// Short names of the render methods, for benchmark results and traces
+extern const char *render_method_names[];
+
+///////////////////////////////////////////////////////////////////////////////
+// Shader stages
+///////////////////////////////////////////////////////////////////////////////
+// A vertex shader writes the varyings of one vertex of a projected triangle,
+// the rasterizer interpolates them to every pixel, and a fragment shader
+// turns them into a color. Anything constant over the triangle is read from
+// its uniforms instead of being interpolated.
+//
+// Shaders are not called through these pointer types: DEFINE_RASTERIZER in
+// raster.h takes them by name and builds a rasterizer around them, so they
+// inline into its inner loop. See pipeline.c for the built-in ones.
+///////////////////////////////////////////////////////////////////////////////
+typedef struct {
+    uint32_t color;             // Already lit with flat shading
+    int level;                  // Light level of the whole triangle, for flat shading
+    const texture_t *texture;
+} uniforms_t;
+
+typedef void (*vertex_shader_t)(const triangle_t *triangle, int vertex, float *varyings);
+typedef uint32_t (*fragment_shader_t)(const uniforms_t *uniforms, const float *varyings);
+
+// Everything a render mode draws for each triangle
+typedef struct {
+    void (*fill)(const triangle_t *triangle);   // Rasterizer built for the mode's shaders, NULL for no fill
+    bool needs_texture;                         // Triangles without a texture are not filled
+    bool has_wireframe;
+    bool has_vertex_points;
+} pipeline_state_t;
+
+const pipeline_state_t *get_pipeline_state(enum render_method render_method, enum shading_method shading_method);
+void draw_pipeline_triangles(const pipeline_state_t *state, const triangle_t *triangles, int num_triangles, bool is_filled);
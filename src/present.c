@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <SDL2/SDL.h>
+#include "present.h"
+#include "display.h"
+#include "capture.h"
+#include "latency.h"
+#include "pacing.h"
+#include "stats.h"
+#include "trace.h"
+
+int present_queue_depth = 1;
+
+///////////////////////////////////////////////////////////////////////////////
+// Frames are used in a ring: a build thread runs update and render into
+// frames[render_index] while the main thread uploads and presents
+// frames[present_index], once present_queue_depth - 1 frames are waiting.
+// SDL's renderer only works on the thread that created it, so every SDL call
+// stays on the main thread and the build thread only writes to our buffers.
+// The main thread samples input while the build thread is idle, and the queue
+// counters only change then too.
+///////////////////////////////////////////////////////////////////////////////
+//
+//   render_index --> [ free ] [ queued ] [ queued ] <-- present_index
+//
+///////////////////////////////////////////////////////////////////////////////
+static uint32_t *frames[MAX_PRESENT_QUEUE_DEPTH];
+static dirty_region_t frames_dirty[MAX_PRESENT_QUEUE_DEPTH];
+// Render size each frame was drawn at, the scale may change while frames are queued
+static SDL_Rect frames_rect[MAX_PRESENT_QUEUE_DEPTH];
+// Earliest input each frame reflects, to measure input-to-present latency
+static double frames_input_time[MAX_PRESENT_QUEUE_DEPTH];
+static int render_index = 0;
+static int present_index = 0;
+static int num_queued_frames = 0;
+static bool is_queue_started = false;
+
+static frame_function_t build_frame = NULL;
+static SDL_Thread *build_thread = NULL;
+static SDL_mutex *build_mutex = NULL;
+static SDL_cond *build_cond = NULL;
+static SDL_cond *built_cond = NULL;
+static bool is_build_requested = false;
+static bool is_stopping = false;
+
+// Presents made while a frame was being built, recorded once the build thread is idle
+// since the latency samples and counters belong to it
+static double presented_input_times[MAX_PRESENT_QUEUE_DEPTH];
+static double presented_times[MAX_PRESENT_QUEUE_DEPTH];
+static int num_presented = 0;
+static int64_t presented_bytes = 0;
+
+static void present_oldest_frame(void)
+{
+    uint32_t *frame = frames[present_index];
+    SDL_Rect frame_rect = frames_rect[present_index];
+
+    trace_begin("upload");
+    SDL_RenderClear(renderer);
+    SDL_UpdateTexture(
+        color_buffer_texture,
+        &frame_rect,
+        frame,
+        (int)(window_width * sizeof(uint32_t)));
+    presented_bytes += (int64_t)frame_rect.w * frame_rect.h * sizeof(uint32_t);
+    SDL_RenderCopy(renderer, color_buffer_texture, &frame_rect, NULL);
+    trace_end();
+    trace_begin("SDL_RenderPresent");
+    SDL_RenderPresent(renderer);
+    trace_end();
+    presented_input_times[num_presented] = frames_input_time[present_index];
+    presented_times[num_presented] = get_time_seconds();
+    num_presented++;
+
+    present_index = (present_index + 1) % present_queue_depth;
+    num_queued_frames--;
+}
+
+// The uploads go into the counters of the frame built next
+static void record_presented_frames(void)
+{
+    for (int i = 0; i < num_presented; i++)
+    {
+        record_frame_latency(presented_input_times[i], presented_times[i]);
+    }
+    STAT_ADD(bytes_uploaded, presented_bytes);
+    num_presented = 0;
+    presented_bytes = 0;
+}
+
+static int build_thread_main(void *data)
+{
+    (void)data;
+    trace_thread_name("build");
+
+    SDL_LockMutex(build_mutex);
+    while (true)
+    {
+        while (!is_stopping && !is_build_requested)
+        {
+            SDL_CondWait(build_cond, build_mutex);
+        }
+        if (is_stopping)
+        {
+            break;
+        }
+        SDL_UnlockMutex(build_mutex);
+
+        build_frame();
+
+        SDL_LockMutex(build_mutex);
+        is_build_requested = false;
+        SDL_CondSignal(built_cond);
+    }
+    SDL_UnlockMutex(build_mutex);
+    return 0;
+}
+
+bool start_present_queue(frame_function_t function)
+{
+    build_frame = function;
+
+    // Headless frames are written out as soon as they are drawn
+    if (is_headless || present_queue_depth <= 1)
+    {
+        present_queue_depth = 1;
+        return true;
+    }
+    if (present_queue_depth > MAX_PRESENT_QUEUE_DEPTH)
+    {
+        present_queue_depth = MAX_PRESENT_QUEUE_DEPTH;
+    }
+
+    // Queued frames have to outlive the texture contents, so we rasterize into our own buffers
+    present_mode = PRESENT_COPY;
+
+    for (int i = 0; i < present_queue_depth; i++)
+    {
+        frames[i] = (uint32_t *)malloc(sizeof(uint32_t) * window_width * window_height);
+        if (!frames[i])
+        {
+            fprintf(stderr, "Error allocating present queue, presenting synchronously. \n");
+            stop_present_queue();
+            return false;
+        }
+        frames_dirty[i].num_rects = 0;
+        frames_dirty[i].is_full = true;
+    }
+    render_index = 0;
+    present_index = 0;
+    num_queued_frames = 0;
+
+    build_mutex = SDL_CreateMutex();
+    build_cond = SDL_CreateCond();
+    built_cond = SDL_CreateCond();
+    is_build_requested = false;
+    is_stopping = false;
+    build_thread = SDL_CreateThread(build_thread_main, "build", NULL);
+    if (!build_thread)
+    {
+        fprintf(stderr, "Error creating build thread, presenting synchronously: %s \n", SDL_GetError());
+        stop_present_queue();
+        return false;
+    }
+    is_queue_started = true;
+
+    return true;
+}
+
+void stop_present_queue(void)
+{
+    if (build_thread)
+    {
+        SDL_LockMutex(build_mutex);
+        is_stopping = true;
+        SDL_CondSignal(build_cond);
+        SDL_UnlockMutex(build_mutex);
+        SDL_WaitThread(build_thread, NULL);
+        build_thread = NULL;
+    }
+    SDL_DestroyCond(built_cond);
+    SDL_DestroyCond(build_cond);
+    SDL_DestroyMutex(build_mutex);
+    built_cond = NULL;
+    build_cond = NULL;
+    build_mutex = NULL;
+
+    // Show the frames still queued before letting go of them
+    while (is_queue_started && num_queued_frames > 0)
+    {
+        present_oldest_frame();
+    }
+    record_presented_frames();
+    is_queue_started = false;
+
+    for (int i = 0; i < MAX_PRESENT_QUEUE_DEPTH; i++)
+    {
+        free(frames[i]);
+        frames[i] = NULL;
+    }
+    present_queue_depth = 1;
+}
+
+// Build the next frame and put it on screen. With a queue the build thread draws it into
+// the free frame while this thread presents the ones that have waited their turn, so the
+// rasterization of one frame overlaps the upload and present of an earlier one.
+void build_and_present_frame(void)
+{
+    if (!is_queue_started)
+    {
+        build_frame();
+        return;
+    }
+
+    SDL_LockMutex(build_mutex);
+    is_build_requested = true;
+    SDL_CondSignal(build_cond);
+    SDL_UnlockMutex(build_mutex);
+
+    while (num_queued_frames > 0 && num_queued_frames >= present_queue_depth - 1)
+    {
+        present_oldest_frame();
+    }
+
+    trace_begin("wait_for_build");
+    SDL_LockMutex(build_mutex);
+    while (is_build_requested)
+    {
+        SDL_CondWait(built_cond, build_mutex);
+    }
+    SDL_UnlockMutex(build_mutex);
+    trace_end();
+
+    record_presented_frames();
+    render_index = (render_index + 1) % present_queue_depth;
+    num_queued_frames++;
+}
+
+// Point color_buffer at the next frame to rasterize. Queued frames are only presented
+// once there are present_queue_depth - 1 of them, so there is always a free one to draw into.
+void begin_present_frame(void)
+{
+    if (is_headless)
+    {
+        lock_color_buffer();
+        return;
+    }
+
+    if (!is_queue_started)
+    {
+        SDL_RenderClear(renderer);
+        lock_color_buffer();
+        return;
+    }
+
+    color_buffer = frames[render_index];
+    color_buffer_pitch = window_width;
+    color_buffer_dirty = &frames_dirty[render_index];
+}
+
+// Present the frame we just rasterized, or leave it for the main thread to queue
+void end_present_frame(void)
+{
+    if (is_headless)
+    {
+        capture_frame(color_buffer, color_buffer_pitch, render_width, render_height);
+        return;
+    }
+
+    if (!is_queue_started)
+    {
+        trace_begin("render_color_buffer");
+        render_color_buffer();
+        trace_end();
+        trace_begin("SDL_RenderPresent");
+        SDL_RenderPresent(renderer);
+        trace_end();
+        record_frame_latency(take_frame_input_time(), get_time_seconds());
+        return;
+    }
+
+    SDL_Rect frame_rect = { 0, 0, render_width, render_height };
+    frames_rect[render_index] = frame_rect;
+    frames_input_time[render_index] = take_frame_input_time();
+}
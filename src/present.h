@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MAX_PRESENT_QUEUE_DEPTH 3
+
+// Number of color buffers in rotation: 1 builds and presents every frame on the main
+// thread, 2 (double) or 3 (triple buffering) build them on a thread of their own while
+// the main thread presents each one 1 or 2 frames later
+extern int present_queue_depth;
+
+// Runs update and render for one frame
+typedef void (*frame_function_t)(void);
+
+bool start_present_queue(frame_function_t build_frame);
+void stop_present_queue(void);
+void build_and_present_frame(void);
+
+void begin_present_frame(void);
+void end_present_frame(void);
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+#include "display.h"
+#include "heatmap.h"
+#include "light.h"
+#include "pipeline.h"
+#include "stats.h"
+#include "swap.h"
+#include "triangle.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Rasterizer template
+///////////////////////////////////////////////////////////////////////////////
+//   DEFINE_RASTERIZER(name, num_varyings, is_perspective, light_varying, vertex, fragment)
+//
+// defines static void name(const triangle_t *triangle), which fills the triangle
+// with the given shaders. Everything but the shaders is a constant here, so
+// the compiler unrolls the interpolation for exactly num_varyings and drops
+// the paths a mode doesn't use, and the inner loop has no mode branches:
+//
+//   is_perspective  varyings are interpolated over w, for texture coordinates
+//   light_varying   index of a varying holding light intensity, or -1. Its
+//                   colors are lit in chunks with the SIMD light_modulate.
+//
+// Spans are shaded in chunks into a local buffer and copied to the color
+// buffer in one go, so the color buffer (possibly a locked texture) is only
+// ever written.
+///////////////////////////////////////////////////////////////////////////////
+#define RASTER_SPAN_CHUNK 64
+
+#define DEFINE_RASTERIZER(name, num_varyings, is_perspective, light_varying, vertex_shader, fragment_shader) \
+static void name##_span(                                                                                  \
+    int x_start, int x_end, int y, const uniforms_t *uniforms,                                           \
+    vec2_t a, vec2_t b, vec2_t c, float attributes[3][(num_varyings) + 1]                                 \
+) {                                                                                                       \
+    STAT_ADD(pixels_tested, x_end - x_start);                                                             \
+    if (y < 0 || y >= render_height) {                                                                    \
+        return;                                                                                           \
+    }                                                                                                     \
+    if (x_start < 0) x_start = 0;                                                                         \
+    if (x_end > render_width) x_end = render_width;                                                       \
+    STAT_ADD(pixels_written, x_end > x_start ? x_end - x_start : 0);                                      \
+    if (heatmap_method != HEATMAP_NONE) {                                                                 \
+        add_heat_span(x_start, x_end, y);                                                                 \
+    }                                                                                                     \
+                                                                                                          \
+    uint32_t colors[RASTER_SPAN_CHUNK];                                                                   \
+    uint16_t levels[RASTER_SPAN_CHUNK];                                                                   \
+    uint32_t *row = &color_buffer[color_buffer_pitch * y];                                                \
+                                                                                                          \
+    for (int chunk_start = x_start; chunk_start < x_end; chunk_start += RASTER_SPAN_CHUNK) {              \
+        int count = x_end - chunk_start < RASTER_SPAN_CHUNK ? x_end - chunk_start : RASTER_SPAN_CHUNK;    \
+                                                                                                          \
+        for (int i = 0; i < count; i++) {                                                                 \
+            vec2_t p = { chunk_start + i, y };                                                            \
+            vec3_t weights = barycentric_weights(a, b, c, p);                                             \
+                                                                                                          \
+            /* The last attribute is 1/w, interpolating it undoes the division by w */                    \
+            float reciprocal_w = (is_perspective) ?                                                       \
+                attributes[0][num_varyings] * weights.x + attributes[1][num_varyings] * weights.y +       \
+                attributes[2][num_varyings] * weights.z : 1;                                              \
+            float varyings[(num_varyings) + 1];                                                           \
+            for (int k = 0; k < (num_varyings); k++) {                                                    \
+                varyings[k] = (attributes[0][k] * weights.x + attributes[1][k] * weights.y +              \
+                    attributes[2][k] * weights.z) / reciprocal_w;                                         \
+            }                                                                                             \
+                                                                                                          \
+            colors[i] = fragment_shader(uniforms, varyings);                                              \
+            if ((light_varying) >= 0) {                                                                   \
+                float light = varyings[(light_varying) < 0 ? 0 : (light_varying)];                        \
+                if (light < 0) light = 0;                                                                 \
+                if (light > 1) light = 1;                                                                 \
+                levels[i] = (uint16_t)(light * 256 + 0.5);                                                \
+            }                                                                                             \
+        }                                                                                                 \
+                                                                                                          \
+        if ((light_varying) >= 0) {                                                                       \
+            light_modulate(colors, levels, count);                                                        \
+        }                                                                                                 \
+        memcpy(&row[chunk_start], colors, sizeof(uint32_t) * count);                                      \
+    }                                                                                                     \
+}                                                                                                         \
+                                                                                                          \
+static void name(const triangle_t *triangle) {                                                            \
+    int xs[3], ys[3];                                                                                     \
+    float attributes[3][(num_varyings) + 1];                                                              \
+    for (int j = 0; j < 3; j++) {                                                                         \
+        xs[j] = triangle->vertices[j].x;                                                                  \
+        ys[j] = triangle->vertices[j].y;                                                                  \
+        vertex_shader(triangle, j, attributes[j]);                                                        \
+        if (is_perspective) {                                                                             \
+            float w = triangle->vertices[j].w;                                                            \
+            for (int k = 0; k < (num_varyings); k++) {                                                    \
+                attributes[j][k] = attributes[j][k] / w;                                                  \
+            }                                                                                             \
+            attributes[j][num_varyings] = 1 / w;                                                          \
+        }                                                                                                 \
+    }                                                                                                     \
+    mark_triangle_dirty(xs[0], ys[0], xs[1], ys[1], xs[2], ys[2]);                                        \
+                                                                                                          \
+    /* Vertices sorted by y, the attributes follow through the order */                                   \
+    int order[3] = { 0, 1, 2 };                                                                           \
+    if (ys[order[0]] > ys[order[1]]) int_swap(&order[0], &order[1]);                                      \
+    if (ys[order[1]] > ys[order[2]]) int_swap(&order[1], &order[2]);                                      \
+    if (ys[order[0]] > ys[order[1]]) int_swap(&order[0], &order[1]);                                      \
+    int x0 = xs[order[0]], y0 = ys[order[0]];                                                             \
+    int x1 = xs[order[1]], y1 = ys[order[1]];                                                             \
+    int x2 = xs[order[2]], y2 = ys[order[2]];                                                             \
+    float sorted[3][(num_varyings) + 1];                                                                  \
+    for (int j = 0; j < 3; j++) {                                                                         \
+        memcpy(sorted[j], attributes[order[j]], sizeof(sorted[j]));                                       \
+    }                                                                                                     \
+                                                                                                          \
+    uniforms_t uniforms = { triangle->color, light_level(triangle->intensities[0]), triangle->texture };  \
+    vec2_t a = { x0, y0 };                                                                                \
+    vec2_t b = { x1, y1 };                                                                                \
+    vec2_t c = { x2, y2 };                                                                                \
+                                                                                                          \
+    /* Flat-bottom half, then flat-top half */                                                            \
+    float inv_slope_1 = 0;                                                                                \
+    float inv_slope_2 = 0;                                                                                \
+    if ((y1 - y0) != 0) inv_slope_1 = (float)(x1 - x0) / abs(y1 - y0);                                    \
+    if ((y2 - y0) != 0) inv_slope_2 = (float)(x2 - x0) / abs(y2 - y0);                                    \
+    if ((y1 - y0) != 0) {                                                                                 \
+        for (int y = y0; y <= y1; y++) {                                                                  \
+            int x_start = x1 + (y - y1) * inv_slope_1;                                                    \
+            int x_end = x0 + (y - y0) * inv_slope_2;                                                      \
+            if (x_end < x_start) {                                                                        \
+                int_swap(&x_start, &x_end);                                                               \
+            }                                                                                             \
+            name##_span(x_start, x_end, y, &uniforms, a, b, c, sorted);                                   \
+        }                                                                                                 \
+    }                                                                                                     \
+                                                                                                          \
+    inv_slope_1 = 0;                                                                                      \
+    inv_slope_2 = 0;                                                                                      \
+    if ((y2 - y1) != 0) inv_slope_1 = (float)(x2 - x1) / abs(y2 - y1);                                    \
+    if ((y2 - y0) != 0) inv_slope_2 = (float)(x2 - x0) / abs(y2 - y0);                                    \
+    if ((y2 - y1) != 0) {                                                                                 \
+        for (int y = y1; y <= y2; y++) {                                                                  \
+            int x_start = x1 + (y - y1) * inv_slope_1;                                                    \
+            int x_end = x0 + (y - y0) * inv_slope_2;                                                      \
+            if (x_end < x_start) {                                                                        \
+                int_swap(&x_start, &x_end);                                                               \
+            }                                                                                             \
+            name##_span(x_start, x_end, y, &uniforms, a, b, c, sorted);                                   \
+        }                                                                                                 \
+    }                                                                                                     \
+}
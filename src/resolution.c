@@ -0,0 +1,84 @@
+#include "resolution.h"
+#include "display.h"
+
+bool is_dynamic_resolution = false;
+
+resolution_config_t resolution_config = {
+    .min_scale = 0.5,
+    .max_scale = 1.0,
+    .step = 0.05,
+    .high_threshold = 0.9,
+    .low_threshold = 0.7,
+    .settle_frames = 15
+};
+
+static float average_frame_time_ms = 0;
+static int frames_over = 0;
+static int frames_under = 0;
+
+///////////////////////////////////////////////////////////////////////////////
+// Render scale controller with hysteresis
+///////////////////////////////////////////////////////////////////////////////
+// The gap between the two thresholds is the dead band where the scale is left
+// alone. Cost grows with the square of the scale, so after dropping a step the
+// frame time lands well below the high threshold and doesn't bounce back up.
+//
+//   frame time:  0 ..... low ~~~~~ dead band ~~~~~ high ..... target
+//                 raise                                lower
+///////////////////////////////////////////////////////////////////////////////
+void update_render_scale(float frame_time_ms, float target_time_ms)
+{
+    if (!is_dynamic_resolution)
+    {
+        return;
+    }
+
+    // Smooth the measurement so a single slow frame doesn't trigger a change
+    if (average_frame_time_ms == 0)
+        average_frame_time_ms = frame_time_ms;
+    average_frame_time_ms += (frame_time_ms - average_frame_time_ms) * 0.2;
+
+    if (average_frame_time_ms > target_time_ms * resolution_config.high_threshold)
+    {
+        frames_over++;
+        frames_under = 0;
+    }
+    else if (average_frame_time_ms < target_time_ms * resolution_config.low_threshold)
+    {
+        frames_under++;
+        frames_over = 0;
+    }
+    else
+    {
+        frames_over = 0;
+        frames_under = 0;
+    }
+
+    float scale = render_scale;
+    if (frames_over >= resolution_config.settle_frames)
+    {
+        scale -= resolution_config.step;
+        frames_over = 0;
+    }
+    else if (frames_under >= resolution_config.settle_frames)
+    {
+        scale += resolution_config.step;
+        frames_under = 0;
+    }
+    else
+    {
+        return;
+    }
+
+    if (scale < resolution_config.min_scale)
+        scale = resolution_config.min_scale;
+    if (scale > resolution_config.max_scale)
+        scale = resolution_config.max_scale;
+
+    if (scale != render_scale)
+    {
+        set_render_scale(scale);
+        // Start measuring the new resolution from scratch
+        average_frame_time_ms = 0;
+    }
+}
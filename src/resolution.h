@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdbool.h>
+
+typedef struct {
+    float min_scale;       // Lowest render scale the controller may drop to
+    float max_scale;       // Highest render scale, 1.0 is native resolution
+    float step;            // How much the scale changes in one adjustment
+    float high_threshold;  // Drop resolution when frame time goes above this fraction of the target
+    float low_threshold;   // Raise resolution when frame time stays below this fraction of the target
+    int settle_frames;     // Consecutive frames past a threshold before the scale changes
+} resolution_config_t;
+
+extern bool is_dynamic_resolution;
+extern resolution_config_t resolution_config;
+
+void update_render_scale(float frame_time_ms, float target_time_ms);
@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include "scene.h"
+#include "array.h"
+
+// Meshes and textures are shared, every instance only references them by index
+scene_t scene = {
+    .meshes = NULL,
+    .textures = NULL,
+    .instances = NULL,
+    .batches = NULL,
+    .bvh = { .nodes = NULL, .items = NULL, .num_nodes = 0 },
+    .item_bounds = NULL,
+    .is_bvh_dirty = false
+};
+
+// Returns the index of the new mesh, or -1 if the file couldn't be loaded
+int scene_load_mesh(char* obj_filename) {
+    mesh_t mesh = { .vertices = NULL, .faces = NULL, .clusters = { .nodes = NULL, .items = NULL, .num_nodes = 0 } };
+    if (!load_obj_file_data(&mesh, obj_filename)) {
+        return -1;
+    }
+    array_push(scene.meshes, mesh);
+    return array_length(scene.meshes) - 1;
+}
+
+// Returns the index of the new texture, or -1 if the file couldn't be loaded
+int scene_load_texture(char* png_filename) {
+    texture_t texture;
+    if (!load_png_texture_data(&texture, png_filename)) {
+        free_texture(&texture);
+        return -1;
+    }
+    array_push(scene.textures, texture);
+    return array_length(scene.textures) - 1;
+}
+
+int scene_add_instance(int mesh, int texture, vec3_t scale, vec3_t rotation, vec3_t translation) {
+    instance_t instance = {
+        .mesh = mesh,
+        .texture = texture,
+        .rotation = rotation,
+        .scale = scale,
+        .translation = translation,
+        .lod = 0
+    };
+    array_push(scene.instances, instance);
+    return array_length(scene.instances) - 1;
+}
+
+int scene_num_instances(void) {
+    return array_length(scene.instances);
+}
+
+int scene_add_instance_batch(int mesh, int texture) {
+    instance_batch_t batch = {
+        .mesh = mesh,
+        .texture = texture,
+        .world_matrices = NULL,
+        .lods = NULL
+    };
+    array_push(scene.batches, batch);
+    return array_length(scene.batches) - 1;
+}
+
+void scene_batch_add_instance(int batch, mat4_t world_matrix) {
+    array_push(scene.batches[batch].world_matrices, world_matrix);
+    array_push(scene.batches[batch].lods, 0);
+}
+
+mat4_t scene_instance_world_matrix(const instance_t* instance) {
+    mat4_t scale_matrix = mat4_make_scale(instance->scale.x, instance->scale.y, instance->scale.z);
+    mat4_t translation_matrix = mat4_make_translation(instance->translation.x, instance->translation.y, instance->translation.z);
+    mat4_t rotation_matrix_x = mat4_make_rotation_x(instance->rotation.x);
+    mat4_t rotation_matrix_y = mat4_make_rotation_y(instance->rotation.y);
+    mat4_t rotation_matrix_z = mat4_make_rotation_z(instance->rotation.z);
+
+    mat4_t world_matrix = mat4_identity();
+    world_matrix = mat4_mul_mat4(scale_matrix, world_matrix);
+    world_matrix = mat4_mul_mat4(rotation_matrix_z, world_matrix);
+    world_matrix = mat4_mul_mat4(rotation_matrix_y, world_matrix);
+    world_matrix = mat4_mul_mat4(rotation_matrix_x, world_matrix);
+    world_matrix = mat4_mul_mat4(translation_matrix, world_matrix);
+    return world_matrix;
+}
+
+// World space bounds of every BVH item, a batch covers all of its instances
+static void update_item_bounds(void) {
+    int num_instances = array_length(scene.instances);
+    int num_batches = array_length(scene.batches);
+
+    array_free(scene.item_bounds);
+    scene.item_bounds = NULL;
+
+    for (int i = 0; i < num_instances; i++) {
+        instance_t* instance = &scene.instances[i];
+        mesh_t* mesh = &scene.meshes[instance->mesh];
+        aabb_t box = { mesh->aabb_min, mesh->aabb_max };
+        aabb_t bounds = aabb_transform(box, scene_instance_world_matrix(instance));
+        array_push(scene.item_bounds, bounds);
+    }
+
+    for (int i = 0; i < num_batches; i++) {
+        instance_batch_t* batch = &scene.batches[i];
+        mesh_t* mesh = &scene.meshes[batch->mesh];
+        aabb_t box = { mesh->aabb_min, mesh->aabb_max };
+        aabb_t bounds = box;
+        for (int j = 0; j < array_length(batch->world_matrices); j++) {
+            aabb_t instance_bounds = aabb_transform(box, batch->world_matrices[j]);
+            bounds = j == 0 ? instance_bounds : aabb_union(bounds, instance_bounds);
+        }
+        array_push(scene.item_bounds, bounds);
+    }
+}
+
+// Objects per BVH leaf, the instanced path still tests each one on its own
+#define SCENE_BVH_LEAF_SIZE 4
+
+void scene_build_bvh(void) {
+    update_item_bounds();
+    bvh_build(&scene.bvh, scene.item_bounds, array_length(scene.item_bounds), SCENE_BVH_LEAF_SIZE);
+    scene.is_bvh_dirty = false;
+}
+
+// Cheaper than a rebuild when instances moved a bit, the tree just gets looser
+void scene_refit_bvh(void) {
+    update_item_bounds();
+    bvh_refit(&scene.bvh, scene.item_bounds);
+    scene.is_bvh_dirty = false;
+}
+
+void free_scene(void) {
+    bvh_free(&scene.bvh);
+    array_free(scene.item_bounds);
+    scene.item_bounds = NULL;
+    for (int i = 0; i < array_length(scene.meshes); i++) {
+        free_mesh(&scene.meshes[i]);
+    }
+    for (int i = 0; i < array_length(scene.textures); i++) {
+        free_texture(&scene.textures[i]);
+    }
+    array_free(scene.meshes);
+    array_free(scene.textures);
+    for (int i = 0; i < array_length(scene.batches); i++) {
+        array_free(scene.batches[i].world_matrices);
+        array_free(scene.batches[i].lods);
+    }
+    array_free(scene.instances);
+    array_free(scene.batches);
+    scene.batches = NULL;
+    scene.meshes = NULL;
+    scene.textures = NULL;
+    scene.instances = NULL;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "vector.h"
+#include "mesh.h"
+#include "texture.h"
+#include <stdbool.h>
+
+// One placement of a mesh in the world
+typedef struct {
+    int mesh;     // Index into scene.meshes
+    int texture;  // Index into scene.textures, -1 when untextured
+    vec3_t rotation;
+    vec3_t scale;
+    vec3_t translation;
+    int lod;      // Level of detail drawn last frame
+} instance_t;
+
+#include "matrix.h"
+
+// Many copies of one mesh drawn with a single instanced call, one world matrix each
+typedef struct {
+    int mesh;
+    int texture;
+    mat4_t* world_matrices;
+    int* lods;    // Level of detail of each instance, drawn last frame
+} instance_batch_t;
+
+#include "bvh.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// The scene BVH holds one item per instance followed by one per batch:
+//   items 0 .. num_instances - 1           -> scene.instances
+//   items num_instances .. + num_batches   -> scene.batches
+///////////////////////////////////////////////////////////////////////////////
+typedef struct {
+    mesh_t* meshes;
+    texture_t* textures;
+    instance_t* instances;
+    instance_batch_t* batches;
+    bvh_t bvh;
+    aabb_t* item_bounds;
+    bool is_bvh_dirty; // Instances moved since the bounds were last refit
+} scene_t;
+
+extern scene_t scene;
+
+int scene_load_mesh(char* obj_filename);
+int scene_load_texture(char* png_filename);
+int scene_add_instance(int mesh, int texture, vec3_t scale, vec3_t rotation, vec3_t translation);
+int scene_num_instances(void);
+int scene_add_instance_batch(int mesh, int texture);
+void scene_batch_add_instance(int batch, mat4_t world_matrix);
+mat4_t scene_instance_world_matrix(const instance_t* instance);
+void scene_build_bvh(void);
+void scene_refit_bvh(void);
+void free_scene(void);
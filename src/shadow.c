@@ -0,0 +1,140 @@
+#include <stdlib.h>
+#include <math.h>
+#include "shadow.h"
+#include "light.h"
+#include "array.h"
+
+bool is_shadow_mapping = false;
+bool is_shadow_pcf = false;
+
+// Receivers count as this much nearer to the light than they are, so surfaces don't shadow themselves
+#define SHADOW_BIAS 0.005
+// and are looked up this many texels away from their surface, along its normal, which
+// covers the depth a slanted surface gains across one texel
+#define SHADOW_NORMAL_OFFSET 1.5
+
+static depth_buffer_t shadow_map = { 0, 0, NULL };
+
+// Light space axes in view space, z points along the light
+static vec3_t light_x;
+static vec3_t light_y;
+static vec3_t light_z;
+// Light space bounds of the scene, and the scale from them to texels and depths
+static float min_x, min_y, max_z;
+static float texels_per_unit_x, texels_per_unit_y, depth_per_unit;
+// Largest side of a texel in view space units
+static float texel_size;
+
+static vec3_t* light_vertices = NULL;
+static int light_vertices_capacity = 0;
+
+// View space point to shadow map texels, z holds the stored depth
+static vec3_t to_shadow_map(vec3_t view) {
+    vec3_t result = {
+        (vec3_dot(view, light_x) - min_x) * texels_per_unit_x,
+        (vec3_dot(view, light_y) - min_y) * texels_per_unit_y,
+        1 + (max_z - vec3_dot(view, light_z)) * depth_per_unit
+    };
+    return result;
+}
+
+void begin_shadow_frame(aabb_t view_bounds) {
+    if (shadow_map.depth == NULL) {
+        init_depth_buffer(&shadow_map, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+    }
+    clear_depth_buffer(&shadow_map);
+
+    light_z = light.direction;
+    vec3_normalize(&light_z);
+    vec3_t up = fabs(light_z.y) < 0.99 ? vec3_new(0, 1, 0) : vec3_new(1, 0, 0);
+    light_x = vec3_cross(up, light_z);
+    vec3_normalize(&light_x);
+    light_y = vec3_cross(light_z, light_x);
+
+    float max_x = -INFINITY, max_y = -INFINITY, min_z = INFINITY;
+    min_x = min_y = INFINITY;
+    max_z = -INFINITY;
+    for (int i = 0; i < 8; i++) {
+        vec3_t corner = {
+            (i & 1) ? view_bounds.max.x : view_bounds.min.x,
+            (i & 2) ? view_bounds.max.y : view_bounds.min.y,
+            (i & 4) ? view_bounds.max.z : view_bounds.min.z
+        };
+        float x = vec3_dot(corner, light_x);
+        float y = vec3_dot(corner, light_y);
+        float z = vec3_dot(corner, light_z);
+        min_x = fminf(min_x, x);
+        max_x = fmaxf(max_x, x);
+        min_y = fminf(min_y, y);
+        max_y = fmaxf(max_y, y);
+        min_z = fminf(min_z, z);
+        max_z = fmaxf(max_z, z);
+    }
+
+    texels_per_unit_x = shadow_map.width / fmaxf(max_x - min_x, 1e-6);
+    texels_per_unit_y = shadow_map.height / fmaxf(max_y - min_y, 1e-6);
+    depth_per_unit = 1 / fmaxf(max_z - min_z, 1e-6);
+    texel_size = 1 / fminf(texels_per_unit_x, texels_per_unit_y);
+}
+
+// Both sides of every face are drawn, the light sees the back faces the camera culls
+void draw_shadow_caster(const mesh_t* mesh, mat4_t model_view) {
+    int num_vertices = array_length(mesh->vertices);
+    if (num_vertices > light_vertices_capacity) {
+        light_vertices_capacity = num_vertices;
+        light_vertices = (vec3_t*)realloc(light_vertices, sizeof(vec3_t) * num_vertices);
+    }
+
+    for (int i = 0; i < num_vertices; i++) {
+        vec3_t view = vec3_from_vec4(mat4_mul_vec4(model_view, vec4_from_vec3(mesh->vertices[i])));
+        light_vertices[i] = to_shadow_map(view);
+    }
+
+    int num_faces = array_length(mesh->faces);
+    for (int i = 0; i < num_faces; i++) {
+        draw_depth_triangle(
+            &shadow_map,
+            light_vertices[mesh->faces[i].a],
+            light_vertices[mesh->faces[i].b],
+            light_vertices[mesh->faces[i].c]
+        );
+    }
+}
+
+// 1 when nothing nearer to the light is stored at the texel, texels outside the map are lit
+static float shadow_test(int x, int y, float depth) {
+    if (x < 0 || y < 0 || x >= shadow_map.width || y >= shadow_map.height) {
+        return 1;
+    }
+    return shadow_map.depth[y * shadow_map.width + x] > depth ? 0 : 1;
+}
+
+// Fraction of the directional light reaching a view space point with the given unit normal,
+// from 0 in full shadow to 1
+float shadow_factor(vec3_t view_position, vec3_t normal) {
+    vec3_t offset = vec3_mul(normal, SHADOW_NORMAL_OFFSET * texel_size);
+    vec3_t p = to_shadow_map(vec3_add(view_position, offset));
+    float depth = p.z + SHADOW_BIAS;
+
+    if (!is_shadow_pcf) {
+        return shadow_test((int)floorf(p.x), (int)floorf(p.y), depth);
+    }
+
+    // Texel centers are at half coordinates, blend the four whose centers surround the point
+    float u = p.x - 0.5;
+    float v = p.y - 0.5;
+    int x = (int)floorf(u);
+    int y = (int)floorf(v);
+    float fx = u - x;
+    float fy = v - y;
+    float top = shadow_test(x, y, depth) * (1 - fx) + shadow_test(x + 1, y, depth) * fx;
+    float bottom = shadow_test(x, y + 1, depth) * (1 - fx) + shadow_test(x + 1, y + 1, depth) * fx;
+    return top * (1 - fy) + bottom * fy;
+}
+
+void free_shadow_map(void) {
+    free_depth_buffer(&shadow_map);
+    free(light_vertices);
+    light_vertices = NULL;
+    light_vertices_capacity = 0;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include "matrix.h"
+#include "mesh.h"
+#include "bvh.h"
+#include "depth.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Shadow mapping
+///////////////////////////////////////////////////////////////////////////////
+// The directional light shines in view space, like the normals it lights, so
+// its shadow map is an orthographic view along light.direction from there.
+// It is fitted around the bounds of the whole scene every frame and drawn
+// with the depth-only rasterizer, before the geometry stage:
+//
+//   begin_shadow_frame()  ->  draw_shadow_caster() ...
+//   ->  shadow_factor() for every lit point in the geometry stage
+//
+// A texel holds how far in front of the far end of the bounds its nearest
+// caster is, plus one. Larger is nearer to the light as the rasterizer wants,
+// and an empty texel (0) never shadows anything. With PCF the four texels
+// around a point are compared and their results blended bilinearly, which
+// softens the stair steps along shadow edges.
+///////////////////////////////////////////////////////////////////////////////
+#define SHADOW_MAP_SIZE 512
+
+extern bool is_shadow_mapping;
+extern bool is_shadow_pcf;
+
+void begin_shadow_frame(aabb_t view_bounds);
+void draw_shadow_caster(const mesh_t* mesh, mat4_t model_view);
+float shadow_factor(vec3_t view_position, vec3_t normal);
+void free_shadow_map(void);
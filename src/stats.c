@@ -0,0 +1,51 @@
+#include <stdio.h>
+#include <string.h>
+#include "stats.h"
+
+frame_stats_t frame_stats;
+frame_stats_t last_frame_stats;
+
+static FILE *stats_csv = NULL;
+static int stats_frame = 0;
+
+bool open_stats_csv(const char *path)
+{
+    stats_csv = fopen(path, "w");
+    if (!stats_csv)
+    {
+        fprintf(stderr, "Error opening stats output %s. \n", path);
+        return false;
+    }
+
+    fprintf(stats_csv, "frame,frame_ms,faces_processed,faces_backface_culled,faces_frustum_culled,faces_occlusion_culled,"
+        "faces_clipped,triangles_rasterized,pixels_tested,pixels_written,texels_fetched,bytes_uploaded\n");
+    return true;
+}
+
+// Keep the counters of the frame just presented for the HUD, write them out and start over
+void finish_frame_stats(float frame_time_ms)
+{
+    last_frame_stats = frame_stats;
+    memset(&frame_stats, 0, sizeof(frame_stats));
+
+    if (stats_csv)
+    {
+        const frame_stats_t *s = &last_frame_stats;
+        fprintf(stats_csv, "%d,%.3f,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld\n",
+            stats_frame, frame_time_ms,
+            (long long)s->faces_processed, (long long)s->faces_backface_culled, (long long)s->faces_frustum_culled,
+            (long long)s->faces_occlusion_culled, (long long)s->faces_clipped, (long long)s->triangles_rasterized,
+            (long long)s->pixels_tested, (long long)s->pixels_written, (long long)s->texels_fetched,
+            (long long)s->bytes_uploaded);
+    }
+    stats_frame++;
+}
+
+void close_stats_csv(void)
+{
+    if (stats_csv)
+    {
+        fclose(stats_csv);
+        stats_csv = NULL;
+    }
+}
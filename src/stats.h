@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Pipeline statistics
+///////////////////////////////////////////////////////////////////////////////
+// Counters of the work done in one frame. Build with -DENABLE_STATS=0 and
+// every STAT_ADD compiles to nothing, the counters then stay at 0.
+//
+// Faces are counted per instance that reaches the geometry stage. There is
+// no triangle clipping, faces reaching past the screen edges are counted as
+// clipped since the rasterizer cuts them there.
+///////////////////////////////////////////////////////////////////////////////
+#ifndef ENABLE_STATS
+#define ENABLE_STATS 1
+#endif
+
+typedef struct {
+    int64_t faces_processed;
+    int64_t faces_backface_culled;
+    int64_t faces_frustum_culled;
+    int64_t faces_occlusion_culled;
+    int64_t faces_clipped;
+    int64_t triangles_rasterized;
+    int64_t pixels_tested;
+    int64_t pixels_written;
+    int64_t texels_fetched;
+    int64_t bytes_uploaded;
+} frame_stats_t;
+
+// Counters of the frame being built, and of the last finished one
+extern frame_stats_t frame_stats;
+extern frame_stats_t last_frame_stats;
+
+#if ENABLE_STATS
+#define STAT_ADD(counter, n) (frame_stats.counter += (n))
+#else
+#define STAT_ADD(counter, n) ((void)0)
+#endif
+
+bool open_stats_csv(const char *path);
+void finish_frame_stats(float frame_time_ms);
+void close_stats_csv(void);
@@ -1,5 +1,6 @@
 #pragma once
 #include "upng.h"
+#include <stdbool.h>
 #include <stdint.h>
 
 typedef struct {
@@ -7,10 +8,12 @@ typedef struct {
     float v;
 } tex2_t;
 
-extern int texture_width;
-extern int texture_height;
-
-extern upng_t* png_texture;
-extern uint32_t* mesh_texture;
+typedef struct {
+    int width;
+    int height;
+    uint32_t* texels;
+    upng_t* png;
+} texture_t;
 
-void load_png_texture_data(char* filename);
+bool load_png_texture_data(texture_t* texture, char* filename);
+void free_texture(texture_t* texture);
@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+#include "trace.h"
+
+bool is_tracing = false;
+
+typedef struct
+{
+    const char *name;
+    uint64_t start_ns;
+    uint64_t end_ns;
+} trace_event_t;
+
+// Only the owning thread writes to its ring and open scopes, num_written publishes the events
+typedef struct
+{
+    const char *name;
+    trace_event_t *events;
+    SDL_atomic_t num_written;
+    const char *open_names[MAX_TRACE_DEPTH];
+    uint64_t open_starts[MAX_TRACE_DEPTH];
+    int depth;
+} trace_thread_t;
+
+static trace_thread_t trace_threads[MAX_TRACE_THREADS];
+static SDL_atomic_t num_trace_threads;
+static SDL_TLSID trace_tls = 0;
+
+static uint64_t trace_start_counter = 0;
+static uint64_t trace_counter_frequency = 1;
+
+// Nanoseconds since start_trace(), split so the multiplication can't overflow
+static uint64_t trace_time_ns(void)
+{
+    uint64_t ticks = SDL_GetPerformanceCounter() - trace_start_counter;
+    return ticks / trace_counter_frequency * 1000000000ull + ticks % trace_counter_frequency * 1000000000ull / trace_counter_frequency;
+}
+
+void start_trace(void)
+{
+    trace_tls = SDL_TLSCreate();
+    trace_counter_frequency = SDL_GetPerformanceFrequency();
+    trace_start_counter = SDL_GetPerformanceCounter();
+    SDL_AtomicSet(&num_trace_threads, 0);
+    is_tracing = true;
+}
+
+// The ring of the calling thread, taken on its first marker, NULL once every ring is in use
+static trace_thread_t *get_trace_thread(void)
+{
+    trace_thread_t *thread = (trace_thread_t *)SDL_TLSGet(trace_tls);
+    if (thread)
+    {
+        return thread;
+    }
+
+    int index = SDL_AtomicAdd(&num_trace_threads, 1);
+    if (index >= MAX_TRACE_THREADS)
+    {
+        return NULL;
+    }
+    thread = &trace_threads[index];
+    thread->events = (trace_event_t *)malloc(sizeof(trace_event_t) * TRACE_RING_SIZE);
+    if (!thread->events)
+    {
+        return NULL;
+    }
+    SDL_TLSSet(trace_tls, thread, NULL);
+    return thread;
+}
+
+void trace_thread_name(const char *name)
+{
+    if (!is_tracing)
+    {
+        return;
+    }
+    trace_thread_t *thread = get_trace_thread();
+    if (thread)
+    {
+        thread->name = name;
+    }
+}
+
+void trace_begin(const char *name)
+{
+    if (!is_tracing)
+    {
+        return;
+    }
+    trace_thread_t *thread = get_trace_thread();
+    if (!thread)
+    {
+        return;
+    }
+
+    // Scopes nested deeper than the stack are counted but not recorded
+    if (thread->depth < MAX_TRACE_DEPTH)
+    {
+        thread->open_names[thread->depth] = name;
+        thread->open_starts[thread->depth] = trace_time_ns();
+    }
+    thread->depth++;
+}
+
+void trace_end(void)
+{
+    if (!is_tracing)
+    {
+        return;
+    }
+    trace_thread_t *thread = get_trace_thread();
+    if (!thread || thread->depth == 0)
+    {
+        return;
+    }
+
+    thread->depth--;
+    if (thread->depth >= MAX_TRACE_DEPTH)
+    {
+        return;
+    }
+
+    int index = SDL_AtomicGet(&thread->num_written);
+    trace_event_t *event = &thread->events[index % TRACE_RING_SIZE];
+    event->name = thread->open_names[thread->depth];
+    event->start_ns = thread->open_starts[thread->depth];
+    event->end_ns = trace_time_ns();
+    SDL_AtomicSet(&thread->num_written, index + 1);
+}
+
+// Every recorded scope as a complete ("X") event, in microseconds, with a name for every thread.
+// Call it once the other threads have stopped.
+bool write_trace(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+    {
+        fprintf(stderr, "Error opening trace output %s. \n", path);
+        return false;
+    }
+
+    int num_threads = SDL_AtomicGet(&num_trace_threads);
+    if (num_threads > MAX_TRACE_THREADS)
+    {
+        num_threads = MAX_TRACE_THREADS;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    bool is_first = true;
+    for (int t = 0; t < num_threads; t++)
+    {
+        trace_thread_t *thread = &trace_threads[t];
+        if (!thread->events)
+        {
+            continue;
+        }
+
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            is_first ? "" : ",\n", t + 1, thread->name ? thread->name : "thread");
+        is_first = false;
+
+        // A full ring holds the last TRACE_RING_SIZE events, starting at the oldest
+        int num_written = SDL_AtomicGet(&thread->num_written);
+        int first = num_written > TRACE_RING_SIZE ? num_written - TRACE_RING_SIZE : 0;
+        for (int i = first; i < num_written; i++)
+        {
+            const trace_event_t *event = &thread->events[i % TRACE_RING_SIZE];
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                event->name, t + 1, event->start_ns / 1000.0, (event->end_ns - event->start_ns) / 1000.0);
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    bool is_written = !ferror(file);
+    fclose(file);
+    if (!is_written)
+    {
+        fprintf(stderr, "Error writing trace output %s. \n", path);
+    }
+    return is_written;
+}
+
+void free_trace(void)
+{
+    for (int t = 0; t < MAX_TRACE_THREADS; t++)
+    {
+        free(trace_threads[t].events);
+        trace_threads[t].events = NULL;
+    }
+    is_tracing = false;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdbool.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Timeline trace
+///////////////////////////////////////////////////////////////////////////////
+// trace_begin() and trace_end() mark a scope on the calling thread. Scopes
+// nest, and every thread records its finished ones into a ring buffer of its
+// own, so recording takes no locks; once a ring is full the oldest events are
+// overwritten. write_trace() turns them into a Chrome trace-event file, to be
+// opened in chrome://tracing or ui.perfetto.dev.
+//
+// Names are kept as pointers and written as they are: pass string literals
+// without quotes or backslashes.
+///////////////////////////////////////////////////////////////////////////////
+#define MAX_TRACE_THREADS 24
+#define TRACE_RING_SIZE 65536
+#define MAX_TRACE_DEPTH 32
+
+// Markers cost a single branch while no trace is being recorded
+extern bool is_tracing;
+
+void start_trace(void);
+void trace_thread_name(const char *name);
+void trace_begin(const char *name);
+void trace_end(void);
+
+bool write_trace(const char *path);
+void free_trace(void);
@@ -6,6 +6,15 @@
 #include <stdlib.h>
 
 
+// Mark the bounding box of a triangle as dirty, one pixel larger to cover rounding in the slopes
+void mark_triangle_dirty(int x0, int y0, int x1, int y1, int x2, int y2) {
+    int min_x = x0 < x1 ? (x0 < x2 ? x0 : x2) : (x1 < x2 ? x1 : x2);
+    int min_y = y0 < y1 ? (y0 < y2 ? y0 : y2) : (y1 < y2 ? y1 : y2);
+    int max_x = x0 > x1 ? (x0 > x2 ? x0 : x2) : (x1 > x2 ? x1 : x2);
+    int max_y = y0 > y1 ? (y0 > y2 ? y0 : y2) : (y1 > y2 ? y1 : y2);
+    mark_dirty_rect(min_x - 1, min_y - 1, max_x - min_x + 3, max_y - min_y + 3);
+}
+
 // Draw a filled a triangle with a flat bottom
 void fill_flat_bottom_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color) {
     // Find the two slopes (two triangle legs)
@@ -18,7 +27,7 @@ void fill_flat_bottom_triangle(int x0, int y0, int x1, int y1, int x2, int y2, u
 
     // Loop all the scanlines from top to bottom
     for (int y = y0; y <= y2; y++) {
-        draw_line(x_start, y, x_end, y, color);
+        draw_hline(x_start, x_end, y, color);
         x_start += inv_slope_1;
         x_end += inv_slope_2;
     }
@@ -36,7 +45,7 @@ void fill_flat_top_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint
 
     // Loop all the scanlines from bottom to top
     for (int y = y2; y >= y0; y--) {
-        draw_line(x_start, y, x_end, y, color);
+        draw_hline(x_start, x_end, y, color);
         x_start -= inv_slope_1;
         x_end -= inv_slope_2;
     }
@@ -45,6 +54,8 @@ void fill_flat_top_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint
 // Draw a filled triangle with the flat-top/flat-bottom method
 // We split the original triangle in two, half flat-bottom and half flat-top
 void draw_filled_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color) {
+    mark_triangle_dirty(x0, y0, x1, y1, x2, y2);
+
     // We need to sort the vertices by y-coordinate ascending (y0 < y1 < y2)
     if (y0 > y1) {
         int_swap(&y0, &y1);
@@ -81,130 +92,6 @@ void draw_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t colo
     draw_line(x2, y2, x0, y0, color);
 }
 
-void draw_texel(
-    int x, int y,
-    uint32_t* texture,
-    vec4_t vertex_a, vec4_t vertex_b, vec4_t vertex_c,
-    tex2_t a_uv, tex2_t b_uv, tex2_t c_uv
-) {
-    vec2_t p = { x, y };
-    vec2_t a = vec2_from_vec4(vertex_a);
-    vec2_t b = vec2_from_vec4(vertex_b);
-    vec2_t c = vec2_from_vec4(vertex_c);
-
-    vec3_t weights = barycentric_weights(a, b, c, p);
-
-    float alpha = weights.x;
-    float beta = weights.y;
-    float gamma = weights.z;
-
-    float interpolated_u;
-    float interpolated_v;
-    float interpolated_reciprocal_w;
-
-    interpolated_u = (a_uv.u / vertex_a.w) * alpha + (b_uv.u / vertex_b.w) * beta + (c_uv.u / vertex_c.w) * gamma;
-    interpolated_v = (a_uv.v / vertex_a.w) * alpha + (b_uv.v / vertex_b.w) * beta + (c_uv.v / vertex_c.w) * gamma;
-    interpolated_reciprocal_w = (1 / vertex_a.w) * alpha + (1 / vertex_b.w) * beta + (1 / vertex_c.w) * gamma;
-
-    interpolated_u /= interpolated_reciprocal_w;
-    interpolated_v /= interpolated_reciprocal_w;
-
-    int tex_x = abs((int)(interpolated_u * texture_width)) % texture_width;
-    int tex_y = abs((int)(interpolated_v * texture_height)) % texture_height;
-
-    draw_pixel(x, y, texture[(texture_width * tex_y) + tex_x]);
-
-}
-
-void draw_textured_triangle(
-    int x0, int y0, float z0, float w0, float u0, float v0,
-    int x1, int y1, float z1, float w1, float u1, float v1,
-    int x2, int y2, float z2, float w2, float u2, float v2,
-    uint32_t* texture
-) {
-    if (y0 > y1) {
-        int_swap(&y0, &y1);
-        int_swap(&x0, &x1);
-        float_swap(&z0, &z1);
-        float_swap(&w0, &w1);
-        float_swap(&u0, &u1);
-        float_swap(&v0, &v1);
-    }
-    if (y1 > y2) {
-        int_swap(&y1, &y2);
-        int_swap(&x1, &x2);
-        float_swap(&z1, &z2);
-        float_swap(&w1, &w2);
-        float_swap(&u1, &u2);
-        float_swap(&v1, &v2);
-    }
-    if (y0 > y1) {
-        int_swap(&y0, &y1);
-        int_swap(&x0, &x1);
-        float_swap(&z0, &z1);
-        float_swap(&w0, &w1);
-        float_swap(&u0, &u1);
-        float_swap(&v0, &v1);
-    }
-
-    vec4_t vertex_a = { x0, y0, z0, w0 };
-    vec4_t vertex_b = { x1, y1, z1, w1 };
-    vec4_t vertex_c = { x2, y2, z2, w2 };
-
-    tex2_t a_uv = {u0, v0};
-    tex2_t b_uv = {u1, v1};
-    tex2_t c_uv = {u2, v2};
-
-    float inv_slope_1 = 0;
-    float inv_slope_2 = 0;
-
-    if((y1 - y0) != 0) inv_slope_1 = (float)(x1 - x0) / abs(y1 - y0);
-    if((y2 - y0) != 0) inv_slope_2 = (float)(x2 - x0) / abs(y2 - y0);
-
-    if((y1 - y0) != 0) {
-        for(int y = y0; y <= y1; y++) {
-            int x_start = x1 + (y - y1) * inv_slope_1;
-            int x_end = x0 + (y - y0) * inv_slope_2;
-
-            if (x_end < x_start) {
-                int_swap(&x_start, &x_end);
-            }
-            for(int x = x_start; x < x_end; x++) {
-                draw_texel(x, y,
-                    mesh_texture,
-                    vertex_a, vertex_b, vertex_c,
-                    a_uv, b_uv, c_uv
-                );
-            }
-        }
-    }
-
-    inv_slope_1 = 0;
-    inv_slope_2 = 0;
-
-    if((y2 - y1) != 0) inv_slope_1 = (float)(x2 - x1) / abs(y2 - y1);
-    if((y2 - y0) != 0) inv_slope_2 = (float)(x2 - x0) / abs(y2 - y0);
-
-    if((y2 - y1) != 0) {
-        for(int y = y1; y <= y2; y++) {
-            int x_start = x1 + (y - y1) * inv_slope_1;
-            int x_end = x0 + (y - y0) * inv_slope_2;
-
-            if (x_end < x_start) {
-                int_swap(&x_start, &x_end);
-            }
-
-            for(int x = x_start; x < x_end; x++) {
-                draw_texel(x, y,
-                    mesh_texture,
-                    vertex_a, vertex_b, vertex_c,
-                      a_uv, b_uv, c_uv
-                );
-            }
-        }
-    }
-}
-
 vec3_t barycentric_weights(vec2_t a, vec2_t b, vec2_t c, vec2_t p) {
     /*  Assuming:
              (B)
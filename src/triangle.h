@@ -11,28 +11,25 @@ typedef struct {
     tex2_t a_uv;
     tex2_t b_uv;
     tex2_t c_uv;
+    int a_vn;       // Indices into the mesh's vertex normals
+    int b_vn;
+    int c_vn;
     uint32_t color;
+    vec3_t normal;  // Object space plane of the face: dot(normal, p) + plane_d = 0
+    float plane_d;
 } face_t;
 
 typedef struct {
     vec4_t vertices[3];
     tex2_t texcoords[3];
+    float intensities[3]; // Light at each vertex, all the same with flat shading
+    vec3_t normals[3];    // View space normal at each vertex, for the local lights
     uint32_t color;
     float avg_depth;
+    texture_t* texture;
 } triangle_t;
 
+void mark_triangle_dirty(int x0, int y0, int x1, int y1, int x2, int y2);
 void draw_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color);
 void draw_filled_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color);
-void draw_texel(
-    int x, int y,
-    uint32_t* texture,
-    vec4_t vertex_a, vec4_t vertex_b, vec4_t vertex_c,
-    tex2_t a_uv, tex2_t b_uv, tex2_t c_uv
-);
-void draw_textured_triangle(
-    int x0, int y0, float z0, float w0, float u0, float v0,
-    int x1, int y1, float z1, float w1, float u1, float v1,
-    int x2, int y2, float z2, float w2, float u2, float v2,
-    uint32_t* texture
-);
 vec3_t barycentric_weights(vec2_t a, vec2_t b, vec2_t c, vec2_t p);